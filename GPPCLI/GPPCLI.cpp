@@ -4,6 +4,7 @@
 import std;
 import Tool;
 import TerminalController;
+import TranslatorDaemon;
 
 namespace fs = std::filesystem;
 
@@ -14,6 +15,27 @@ int main(int argc, char* argv[])
     SetConsoleCP(CP_UTF8);
     SetConsoleOutputCP(CP_UTF8);
 
+    // 以常驻进程运行，之后启动的 CLI 会把任务交给它
+    if (argc > 1 && std::string(argv[1]) == "--daemon") {
+        try {
+            runTranslatorDaemon(defaultDaemonPipeName, spdlog::default_logger());
+        }
+        catch (const std::exception& e) {
+            spdlog::critical("[常驻进程错误] {}", e.what());
+            return 1;
+        }
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--stop-daemon") {
+        if (stopDaemon(defaultDaemonPipeName)) {
+            spdlog::info("常驻进程正在退出");
+        }
+        else {
+            spdlog::warn("没有正在运行的常驻进程");
+        }
+        return 0;
+    }
+
     fs::path currentProjectPath;
 
     while (true) {
@@ -64,13 +86,20 @@ int main(int argc, char* argv[])
             spdlog::info("开始处理项目: {}", wide2Ascii(currentProjectPath.wstring()));
 
             {
-                std::unique_ptr<ITranslator> translator = createTranslator(currentProjectPath, std::make_shared<TerminalController>());
-                if (!translator) {
-                    spdlog::error("创建翻译器实例失败，请检查项目配置。");
-                    continue;
+                std::shared_ptr<TerminalController> controller = std::make_shared<TerminalController>();
+                // 有常驻进程时交给它运行，省去重新加载字典和模型的时间
+                if (submitToDaemon(defaultDaemonPipeName, currentProjectPath, controller)) {
+                    spdlog::info("任务已由常驻进程完成");
+                }
+                else {
+                    std::unique_ptr<ITranslator> translator = createTranslator(currentProjectPath, controller);
+                    if (!translator) {
+                        spdlog::error("创建翻译器实例失败，请检查项目配置。");
+                        continue;
+                    }
+
+                    translator->run();
                 }
-
-                translator->run();
             }
 
             std::cout << std::endl;
@@ -27,6 +27,10 @@ export {
         // main function
         inline void update(int ticks, bool removeCurrentLine);
 
+        void add_cycles(int n) {
+            n_cycles += n;
+        }
+
         void add_thread_num() {
             current_thread_num++;
             update(0, true);
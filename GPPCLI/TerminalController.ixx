@@ -20,6 +20,14 @@ export {
             m_bar->update(0, false);
         }
 
+        virtual void extendBar(int moreSentences) override {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_bar) {
+                throw std::runtime_error("ProgressBar not created");
+            }
+            m_bar->add_cycles(moreSentences);
+        }
+
         virtual void writeLog(const std::string& log) override {
             std::lock_guard<std::mutex> lock(m_mutex);
             m_log += log;
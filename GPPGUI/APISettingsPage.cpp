@@ -45,6 +45,7 @@ void APISettingsPage::apply2Config()
         apiTable.insert("apiurl", apiRow.urlEdit->text().toStdString());
         apiTable.insert("modelName", apiRow.modelEdit->text().toStdString());
         apiTable.insert("stream", apiRow.streamSwitch->getIsToggled());
+        apiTable.insert("streamUsage", apiRow.streamUsageSwitch->getIsToggled());
         apiArray.push_back(apiTable);
     }
     insertToml(_projectConfig, "backendSpecific.OpenAI-Compatible.apis", apiArray);
@@ -73,7 +74,8 @@ void APISettingsPage::_setupUI()
             std::string url = (*tbl)["apiurl"].value_or("");
             std::string model = (*tbl)["modelName"].value_or("");
             bool stream = (*tbl)["stream"].value_or(false);
-            ElaScrollPageArea* newRowWidget = _createApiInputRowWidget(QString::fromStdString(key), QString::fromStdString(url), QString::fromStdString(model), stream);
+            bool streamUsage = (*tbl)["streamUsage"].value_or(true);
+            ElaScrollPageArea* newRowWidget = _createApiInputRowWidget(QString::fromStdString(key), QString::fromStdString(url), QString::fromStdString(model), stream, streamUsage);
             _mainLayout->addWidget(newRowWidget);
         }
         if (apis->size() == 0) {
@@ -153,7 +155,7 @@ void APISettingsPage::_addApiInputRow()
 }
 
 // 【新增】这个函数创建一整行带边框和删除按钮的UI
-ElaScrollPageArea* APISettingsPage::_createApiInputRowWidget(const QString& key, const QString& url, const QString& model, bool stream)
+ElaScrollPageArea* APISettingsPage::_createApiInputRowWidget(const QString& key, const QString& url, const QString& model, bool stream, bool streamUsage)
 {
     // 1. 创建带边框的容器 ElaScrollPageArea
     ElaScrollPageArea* container = new ElaScrollPageArea(this);
@@ -236,6 +238,18 @@ ElaScrollPageArea* APISettingsPage::_createApiInputRowWidget(const QString& key,
     streamSwitch->setIsToggled(stream);
     streamLayout->addWidget(streamSwitch);
     rightLayout->addWidget(streamContainer);
+    QWidget* streamUsageContainer = new QWidget(rightContainer);
+    QHBoxLayout* streamUsageLayout = new QHBoxLayout(streamUsageContainer);
+    streamUsageLayout->addStretch();
+    ElaText* streamUsageLabel = new ElaText("流式用量", streamUsageContainer);
+    streamUsageLabel->setTextPixelSize(13);
+    ElaToolTip* streamUsageTip = new ElaToolTip(streamUsageLabel);
+    streamUsageTip->setToolTip("流式请求时附带 stream_options.include_usage 以统计 token 用量，较旧的 llama.cpp、Sakura 等后端不支持时关闭");
+    streamUsageLayout->addWidget(streamUsageLabel);
+    ElaToggleSwitch* streamUsageSwitch = new ElaToggleSwitch(streamUsageContainer);
+    streamUsageSwitch->setIsToggled(streamUsage);
+    streamUsageLayout->addWidget(streamUsageSwitch);
+    rightLayout->addWidget(streamUsageContainer);
     rightLayout->addStretch();
 
     // 5. 组合布局
@@ -249,6 +263,7 @@ ElaScrollPageArea* APISettingsPage::_createApiInputRowWidget(const QString& key,
     newRowControls.urlEdit = urlEdit;
     newRowControls.modelEdit = modelEdit;
     newRowControls.streamSwitch = streamSwitch;
+    newRowControls.streamUsageSwitch = streamUsageSwitch;
     _apiRows.append(newRowControls);
 
     return container;
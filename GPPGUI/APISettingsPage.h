@@ -37,12 +37,13 @@ private:
         ElaLineEdit* urlEdit;
         ElaLineEdit* modelEdit;
         ElaToggleSwitch* streamSwitch;
+        ElaToggleSwitch* streamUsageSwitch;
     };
     QList<ApiRowControls> _apiRows;
 
     void _setupUI();
     // 创建一个新的API输入行（现在返回一个ElaScrollPageArea*）
-    ElaScrollPageArea* _createApiInputRowWidget(const QString& key = "", const QString& url = "", const QString& model = "", bool stream = false);
+    ElaScrollPageArea* _createApiInputRowWidget(const QString& key = "", const QString& url = "", const QString& model = "", bool stream = false, bool streamUsage = true);
 };
 
 #endif // APISETTINGSPAGE_H
@@ -13,6 +13,7 @@
 #include "ElaMessageBar.h"
 #include "ValueSliderWidget.h"
 #include "ElaText.h"
+#include "ElaSpinBox.h"
 
 import Tool;
 
@@ -90,6 +91,52 @@ EpubCfgPage::EpubCfgPage(toml::table& projectConfig, QWidget* parent) : BasePage
 	scaleLayout->addWidget(scaleSlider);
 	mainLayout->addWidget(scaleArea);
 
+	// 保存中间HTML
+	bool saveIntermediateHtml = _projectConfig["plugins"]["Epub"]["保存中间HTML"].value_or(true);
+	ElaScrollPageArea* saveHtmlArea = new ElaScrollPageArea(centerWidget);
+	QHBoxLayout* saveHtmlLayout = new QHBoxLayout(saveHtmlArea);
+	ElaText* saveHtmlText = new ElaText("保存中间HTML", saveHtmlArea);
+	saveHtmlText->setTextPixelSize(16);
+	ElaToolTip* saveHtmlTip = new ElaToolTip(saveHtmlText);
+	saveHtmlTip->setToolTip("在项目目录下保存 epub_show_normal 和 epub_show_normal_post，便于调试正则");
+	saveHtmlLayout->addWidget(saveHtmlText);
+	saveHtmlLayout->addStretch();
+	ElaToggleSwitch* saveHtmlSwitch = new ElaToggleSwitch(saveHtmlArea);
+	saveHtmlSwitch->setIsToggled(saveIntermediateHtml);
+	saveHtmlLayout->addWidget(saveHtmlSwitch);
+	mainLayout->addWidget(saveHtmlArea);
+
+	// 跨章节去重
+	int dedupMinChapters = _projectConfig["plugins"]["Epub"]["跨章节去重"].value_or(0);
+	ElaScrollPageArea* dedupArea = new ElaScrollPageArea(centerWidget);
+	QHBoxLayout* dedupLayout = new QHBoxLayout(dedupArea);
+	ElaText* dedupText = new ElaText("跨章节去重", dedupArea);
+	dedupText->setTextPixelSize(16);
+	ElaToolTip* dedupTip = new ElaToolTip(dedupText);
+	dedupTip->setToolTip("同一本书中至少出现在这么多个章节里的文本(页眉、目次等)只翻译一次，0 为关闭");
+	dedupLayout->addWidget(dedupText);
+	dedupLayout->addStretch();
+	ElaSpinBox* dedupSpinBox = new ElaSpinBox(dedupArea);
+	dedupSpinBox->setRange(0, 1000);
+	dedupSpinBox->setValue(dedupMinChapters);
+	dedupLayout->addWidget(dedupSpinBox);
+	mainLayout->addWidget(dedupArea);
+
+	// 对照Gumbo提取
+	bool compareWithGumbo = _projectConfig["plugins"]["Epub"]["对照Gumbo提取"].value_or(false);
+	ElaScrollPageArea* gumboArea = new ElaScrollPageArea(centerWidget);
+	QHBoxLayout* gumboLayout = new QHBoxLayout(gumboArea);
+	ElaText* gumboText = new ElaText("对照Gumbo提取", gumboArea);
+	gumboText->setTextPixelSize(16);
+	ElaToolTip* gumboTip = new ElaToolTip(gumboText);
+	gumboTip->setToolTip("同时用 Gumbo 解析每个章节并与流式提取逐节点对照，不一致时记录日志并改用 Gumbo 的结果");
+	gumboLayout->addWidget(gumboText);
+	gumboLayout->addStretch();
+	ElaToggleSwitch* gumboSwitch = new ElaToggleSwitch(gumboArea);
+	gumboSwitch->setIsToggled(compareWithGumbo);
+	gumboLayout->addWidget(gumboSwitch);
+	mainLayout->addWidget(gumboArea);
+
 	// 预处理正则
 	toml::table preRegexTable = toml::table{};
 	auto preRegexArr = _projectConfig["plugins"]["Epub"]["预处理正则"].as_array();
@@ -157,6 +204,9 @@ EpubCfgPage::EpubCfgPage(toml::table& projectConfig, QWidget* parent) : BasePage
 			insertToml(_projectConfig, "plugins.Epub.双语显示", outputSwitch->getIsToggled());
 			insertToml(_projectConfig, "plugins.Epub.原文颜色", colorDialog->getCurrentColorRGB().toStdString());
 			insertToml(_projectConfig, "plugins.Epub.缩小比例", scaleSlider->value());
+			insertToml(_projectConfig, "plugins.Epub.保存中间HTML", saveHtmlSwitch->getIsToggled());
+			insertToml(_projectConfig, "plugins.Epub.跨章节去重", dedupSpinBox->value());
+			insertToml(_projectConfig, "plugins.Epub.对照Gumbo提取", gumboSwitch->getIsToggled());
 
 			try {
 				toml::table preTbl = toml::parse(preRegexEdit->toPlainText().toStdString());
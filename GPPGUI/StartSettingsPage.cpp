@@ -148,6 +148,7 @@ void StartSettingsPage::_setupUI()
 	translateMode->addItem("GenDict");
 	translateMode->addItem("Rebuild");
 	translateMode->addItem("ShowNormal");
+	translateMode->addItem("DryRun");
 	if (!transEngineStr.isEmpty()) {
 		int index = translateMode->findText(transEngineStr);
 		if (index >= 0) {
@@ -211,6 +212,10 @@ void StartSettingsPage::_setupUI()
 			_remainTimeLabel->display("--:--");
 			_estimator.reset();
 		});
+	connect(_worker, &TranslatorWorker::extendBarSignal, this, [=](int moreSentences)
+		{
+			_progressBar->setMaximum(_progressBar->maximum() + moreSentences);
+		});
 	connect(_worker, &TranslatorWorker::writeLogSignal, this, [=](QString log)
 		{
 			// 1. 滚动条判断
@@ -383,6 +388,15 @@ void StartSettingsPage::_workFinished(int exitCode)
 				5000                          // 显示时长 (毫秒)
 			);
 		}
+		else if (_transEngine == "DryRun") {
+			ElaMessageBar::success(ElaMessageBarType::BottomRight, "预估完成", "请在项目 " + QString(_projectDir.filename().wstring()) + " 的 翻译预估.json 中查看预估结果。", 3000);
+			trayIcon->showMessage(
+				"预估完成",                  // 标题
+				"请在项目 " + QString(_projectDir.filename().wstring()) + " 的 翻译预估.json 中查看预估结果。",      // 内容
+				QSystemTrayIcon::Information, // 图标类型 (Information, Warning, Critical)
+				5000                          // 显示时长 (毫秒)
+			);
+		}
 		else {
 			ElaMessageBar::success(ElaMessageBarType::BottomRight, "翻译完成", "请在 gt_output 文件夹中查收项目 " + QString(_projectDir.filename().wstring()) + " 的翻译结果。", 3000);
 			trayIcon->showMessage(
@@ -15,6 +15,12 @@ public:
         _makeBarCallback(totalSentences, totalThreads);
     }
 
+    virtual void extendBar(int moreSentences) override
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _extendBarCallback(moreSentences);
+    }
+
     virtual void writeLog(const std::string& log) override
     {
         std::lock_guard<std::mutex> lock(_mutex);
@@ -55,10 +61,10 @@ public:
         _progress = 0;
     }
 
-    GUIController(std::function<void(int, int)> makeBarCallback, std::function<void(const std::string&)> writeLogCallback,
+    GUIController(std::function<void(int, int)> makeBarCallback, std::function<void(int)> extendBarCallback, std::function<void(const std::string&)> writeLogCallback,
         std::function<void()> addThreadNumCallback, std::function<void()> reduceThreadNumCallback, std::function<void(int)> updateBarCallback, 
         std::function<bool()> shouldStopCallback) :
-        _makeBarCallback{ makeBarCallback }, _writeLogCallback{ writeLogCallback }, _addThreadNumCallback{ addThreadNumCallback },
+        _makeBarCallback{ makeBarCallback }, _extendBarCallback{ extendBarCallback }, _writeLogCallback{ writeLogCallback }, _addThreadNumCallback{ addThreadNumCallback },
         _reduceThreadNumCallback{ reduceThreadNumCallback }, _updateBarCallback{ updateBarCallback }, _shouldStopCallback{ shouldStopCallback }
     {
         _log.reserve(1024 * 1024);
@@ -81,6 +87,7 @@ public:
 
 private:
     std::function<void(int, int)> _makeBarCallback;
+    std::function<void(int)> _extendBarCallback;
     std::function<void(const std::string&)> _writeLogCallback;
     std::function<void()> _addThreadNumCallback;
     std::function<void()> _reduceThreadNumCallback;
@@ -106,6 +113,10 @@ void TranslatorWorker::doTranslation()
         {
             Q_EMIT makeBarSignal(totalSentences, totalThreads);
         };
+    auto extendBarCallback = [this](int moreSentences)
+        {
+            Q_EMIT extendBarSignal(moreSentences);
+        };
     auto writeLogCallback = [this](const std::string& log)
         {
             Q_EMIT writeLogSignal(QString::fromStdString(log));
@@ -126,7 +137,7 @@ void TranslatorWorker::doTranslation()
         {
             return this->_shouldStop.load();
         };
-    std::shared_ptr<GUIController> controller = std::make_shared<GUIController>(makeBarCallback, writeLogCallback,
+    std::shared_ptr<GUIController> controller = std::make_shared<GUIController>(makeBarCallback, extendBarCallback, writeLogCallback,
         addThreadNumCallback, reduceThreadNumCallback, updateBarCallback, shouldStopCallback);
     try {
 
@@ -23,6 +23,7 @@ Q_SIGNALS:
     void translationFinished(int exitCode);
 
     void makeBarSignal(int totalSentences, int totalThreads);
+    void extendBarSignal(int moreSentences);
     void writeLogSignal(QString log);
     void addThreadNumSignal();
     void reduceThreadNumSignal();
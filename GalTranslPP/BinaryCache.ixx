@@ -0,0 +1,338 @@
+export module BinaryCache;
+
+import Tool;
+import JsonReader;
+import JsonWriter;
+import ZstdCodec;
+
+namespace fs = std::filesystem;
+
+export {
+
+    /**
+    * @brief 二进制缓存(.gtc)的文件布局，所有整数均为小端
+    * 头部 | 字符串表项 | 字符串数据 | 定长记录 | other_info 表项 | 按上下文键哈希排序的索引
+    */
+    struct BinaryCacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t recordCount;
+        uint32_t stringCount;
+        uint32_t otherInfoCount;
+        uint32_t reserved;
+        uint64_t stringEntriesOffset;
+        uint64_t stringDataOffset;
+        uint64_t recordsOffset;
+        uint64_t otherInfoOffset;
+        uint64_t indexOffset;
+    };
+
+    struct BinaryCacheString {
+        uint64_t offset;
+        uint32_t length;
+        uint32_t reserved;
+    };
+
+    struct BinaryCacheRecord {
+        int32_t index;
+        // 以下均为字符串表中的序号
+        uint32_t name;
+        uint32_t namePreview;
+        uint32_t originalText;
+        uint32_t preProcessedText;
+        uint32_t preTranslatedText;
+        uint32_t problem;
+        uint32_t translatedBy;
+        uint32_t translatedPreview;
+        uint32_t otherInfoBegin;
+        uint32_t otherInfoCount;
+    };
+
+    struct BinaryCacheOtherInfo {
+        uint32_t key;
+        uint32_t value;
+    };
+
+    struct BinaryCacheIndexEntry {
+        uint64_t keyHash;
+        uint32_t record;
+        uint32_t reserved;
+    };
+
+    /**
+    * @brief 内存映射方式打开的二进制缓存，可以不展开全部记录直接按上下文键查找
+    * 经过 zstd 压缩的缓存会先整体解压到内存中
+    */
+    class BinaryCache {
+    private:
+        MappedFile m_file;
+        std::string m_decompressed;
+        const BinaryCacheHeader* m_header = nullptr;
+        const BinaryCacheString* m_strings = nullptr;
+        const char* m_stringData = nullptr;
+        const BinaryCacheRecord* m_records = nullptr;
+        const BinaryCacheOtherInfo* m_otherInfos = nullptr;
+        const BinaryCacheIndexEntry* m_index = nullptr;
+
+        std::string_view getString(uint32_t id) const;
+        std::string keyPart(size_t i) const;
+
+    public:
+        explicit BinaryCache(const fs::path& path, const ZstdCodec* codec = nullptr);
+
+        size_t size() const { return m_header->recordCount; }
+
+        Sentence get(size_t i) const;
+
+        std::vector<Sentence> readAll() const;
+
+        /**
+        * @brief 按 generateCacheKey 生成的键查找，有重复时返回最靠前的记录
+        */
+        std::optional<size_t> find(const std::string& key) const;
+    };
+
+    /**
+    * @brief 以二进制格式保存缓存，与 saveCache 一样只写入已完成的句子
+    */
+    void saveCacheBinary(const std::vector<Sentence>& allSentences, const fs::path& cachePath, const ZstdCodec* codec = nullptr);
+
+    /**
+    * @brief 按扩展名读取 .json 或 .gtc 缓存
+    */
+    std::vector<Sentence> readCacheFile(const fs::path& cachePath, const ZstdCodec* codec = nullptr);
+
+    /**
+    * @brief 在 .json 和 .gtc 之间转换缓存文件，方向由两个路径的扩展名决定
+    * @param writeCodec 写出时使用的压缩设置，为空时不压缩
+    */
+    void convertCacheFile(const fs::path& fromPath, const fs::path& toPath, const ZstdCodec* readCodec, const ZstdCodec* writeCodec);
+}
+
+
+module :private;
+
+constexpr char binaryCacheMagic[4] = { 'G', 'T', 'C', '\0' };
+constexpr uint32_t binaryCacheVersion = 1;
+
+BinaryCache::BinaryCache(const fs::path& path, const ZstdCodec* codec) : m_file(path) {
+    const char* base = m_file.data();
+    size_t fileSize = m_file.size();
+    if (isZstdFrame(std::string_view(base, fileSize))) {
+        m_decompressed = decompressZstd(std::string_view(base, fileSize), codec);
+        base = m_decompressed.data();
+        fileSize = m_decompressed.size();
+    }
+    if (fileSize < sizeof(BinaryCacheHeader)) {
+        throw std::runtime_error(std::format("二进制缓存 {} 已损坏", wide2Ascii(path)));
+    }
+    m_header = reinterpret_cast<const BinaryCacheHeader*>(base);
+    if (std::memcmp(m_header->magic, binaryCacheMagic, 4) != 0 || m_header->version != binaryCacheVersion) {
+        throw std::runtime_error(std::format("{} 不是可识别的二进制缓存", wide2Ascii(path)));
+    }
+    auto checkSection = [&](uint64_t offset, uint64_t count, size_t elemSize)
+        {
+            if (offset > fileSize || count * elemSize > fileSize - offset) {
+                throw std::runtime_error(std::format("二进制缓存 {} 已损坏", wide2Ascii(path)));
+            }
+        };
+    checkSection(m_header->stringEntriesOffset, m_header->stringCount, sizeof(BinaryCacheString));
+    checkSection(m_header->recordsOffset, m_header->recordCount, sizeof(BinaryCacheRecord));
+    checkSection(m_header->otherInfoOffset, m_header->otherInfoCount, sizeof(BinaryCacheOtherInfo));
+    checkSection(m_header->indexOffset, m_header->recordCount, sizeof(BinaryCacheIndexEntry));
+    checkSection(m_header->stringDataOffset, 0, 1);
+
+    m_strings = reinterpret_cast<const BinaryCacheString*>(base + m_header->stringEntriesOffset);
+    m_stringData = base + m_header->stringDataOffset;
+    m_records = reinterpret_cast<const BinaryCacheRecord*>(base + m_header->recordsOffset);
+    m_otherInfos = reinterpret_cast<const BinaryCacheOtherInfo*>(base + m_header->otherInfoOffset);
+    m_index = reinterpret_cast<const BinaryCacheIndexEntry*>(base + m_header->indexOffset);
+
+    for (uint32_t i = 0; i < m_header->stringCount; ++i) {
+        checkSection(m_header->stringDataOffset + m_strings[i].offset, m_strings[i].length, 1);
+    }
+}
+
+std::string_view BinaryCache::getString(uint32_t id) const {
+    if (id >= m_header->stringCount) {
+        throw std::runtime_error("二进制缓存中的字符串序号越界");
+    }
+    return std::string_view(m_stringData + m_strings[id].offset, m_strings[id].length);
+}
+
+std::string BinaryCache::keyPart(size_t i) const {
+    const BinaryCacheRecord& record = m_records[i];
+    std::string part;
+    part.append(getString(record.name));
+    part.append(getString(record.originalText));
+    part.append(getString(record.preProcessedText));
+    return part;
+}
+
+Sentence BinaryCache::get(size_t i) const {
+    const BinaryCacheRecord& record = m_records[i];
+    Sentence se;
+    se.index = record.index;
+    se.name = getString(record.name);
+    se.name_preview = getString(record.namePreview);
+    se.original_text = getString(record.originalText);
+    se.pre_processed_text = getString(record.preProcessedText);
+    se.pre_translated_text = getString(record.preTranslatedText);
+    se.problem = getString(record.problem);
+    se.translated_by = getString(record.translatedBy);
+    se.translated_preview = getString(record.translatedPreview);
+    if ((uint64_t)record.otherInfoBegin + record.otherInfoCount > m_header->otherInfoCount) {
+        throw std::runtime_error("二进制缓存中的 other_info 越界");
+    }
+    for (uint32_t j = 0; j < record.otherInfoCount; ++j) {
+        const BinaryCacheOtherInfo& info = m_otherInfos[record.otherInfoBegin + j];
+        se.other_info[std::string(getString(info.key))] = getString(info.value);
+    }
+    se.complete = true;
+    return se;
+}
+
+std::vector<Sentence> BinaryCache::readAll() const {
+    std::vector<Sentence> sentences;
+    sentences.reserve(size());
+    for (size_t i = 0; i < size(); ++i) {
+        sentences.push_back(get(i));
+    }
+    return sentences;
+}
+
+std::optional<size_t> BinaryCache::find(const std::string& key) const {
+    uint64_t keyHash = fnv1a64(key);
+    const BinaryCacheIndexEntry* indexEnd = m_index + m_header->recordCount;
+    const BinaryCacheIndexEntry* it = std::lower_bound(m_index, indexEnd, keyHash, [](const BinaryCacheIndexEntry& entry, uint64_t hash)
+        {
+            return entry.keyHash < hash;
+        });
+    // 同一个哈希下记录按序号升序排列，与 json 缓存先插入者优先的行为一致
+    for (; it != indexEnd && it->keyHash == keyHash; ++it) {
+        size_t i = it->record;
+        if (i >= size()) {
+            continue;
+        }
+        std::string candidate = (i > 0 ? keyPart(i - 1) : "None") + keyPart(i) + (i + 1 < size() ? keyPart(i + 1) : "None");
+        if (candidate == key) {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+void saveCacheBinary(const std::vector<Sentence>& allSentences, const fs::path& cachePath, const ZstdCodec* codec) {
+    std::vector<const Sentence*> completed;
+    for (const auto& se : allSentences) {
+        if (se.complete) {
+            completed.push_back(&se);
+        }
+    }
+
+    // 相同的字符串只存一份，0 号固定为空串
+    std::unordered_map<std::string_view, uint32_t> stringIds;
+    std::vector<BinaryCacheString> strings;
+    std::string stringData;
+    auto addString = [&](std::string_view str) -> uint32_t
+        {
+            auto it = stringIds.find(str);
+            if (it != stringIds.end()) {
+                return it->second;
+            }
+            uint32_t id = (uint32_t)strings.size();
+            strings.push_back({ stringData.size(), (uint32_t)str.length(), 0 });
+            stringData.append(str);
+            stringIds.emplace(str, id);
+            return id;
+        };
+    addString("");
+
+    std::vector<BinaryCacheRecord> records;
+    std::vector<BinaryCacheOtherInfo> otherInfos;
+    std::vector<BinaryCacheIndexEntry> index;
+    records.reserve(completed.size());
+    index.reserve(completed.size());
+    auto keyPart = [](const Sentence* s) { return s->name + s->original_text + s->pre_processed_text; };
+    for (size_t i = 0; i < completed.size(); ++i) {
+        const Sentence* se = completed[i];
+        BinaryCacheRecord record{};
+        record.index = se->index;
+        record.name = addString(se->name);
+        record.namePreview = addString(se->name_preview);
+        record.originalText = addString(se->original_text);
+        record.preProcessedText = addString(se->pre_processed_text);
+        record.preTranslatedText = addString(se->pre_translated_text);
+        record.problem = addString(se->problem);
+        record.translatedBy = addString(se->translated_by);
+        record.translatedPreview = addString(se->translated_preview);
+        record.otherInfoBegin = (uint32_t)otherInfos.size();
+        record.otherInfoCount = (uint32_t)se->other_info.size();
+        for (const auto& [k, v] : se->other_info) {
+            otherInfos.push_back({ addString(k), addString(v) });
+        }
+        records.push_back(record);
+
+        // 与读取 json 缓存时一样，以缓存文件内的前后句作为上下文
+        std::string key = (i > 0 ? keyPart(completed[i - 1]) : "None") + keyPart(se) + (i + 1 < completed.size() ? keyPart(completed[i + 1]) : "None");
+        index.push_back({ fnv1a64(key), (uint32_t)i, 0 });
+    }
+    std::ranges::sort(index, [](const BinaryCacheIndexEntry& a, const BinaryCacheIndexEntry& b)
+        {
+            return a.keyHash != b.keyHash ? a.keyHash < b.keyHash : a.record < b.record;
+        });
+
+    auto align8 = [](uint64_t offset) { return (offset + 7) & ~uint64_t(7); };
+    BinaryCacheHeader header{};
+    std::memcpy(header.magic, binaryCacheMagic, 4);
+    header.version = binaryCacheVersion;
+    header.recordCount = (uint32_t)records.size();
+    header.stringCount = (uint32_t)strings.size();
+    header.otherInfoCount = (uint32_t)otherInfos.size();
+    header.stringEntriesOffset = align8(sizeof(BinaryCacheHeader));
+    header.stringDataOffset = align8(header.stringEntriesOffset + strings.size() * sizeof(BinaryCacheString));
+    header.recordsOffset = align8(header.stringDataOffset + stringData.size());
+    header.otherInfoOffset = align8(header.recordsOffset + records.size() * sizeof(BinaryCacheRecord));
+    header.indexOffset = align8(header.otherInfoOffset + otherInfos.size() * sizeof(BinaryCacheOtherInfo));
+
+    std::string fileData;
+    fileData.reserve(header.indexOffset + index.size() * sizeof(BinaryCacheIndexEntry));
+    auto writeSection = [&](uint64_t offset, const void* data, size_t size)
+        {
+            fileData.resize(offset, '\0');
+            fileData.append(static_cast<const char*>(data), size);
+        };
+    writeSection(0, &header, sizeof(header));
+    writeSection(header.stringEntriesOffset, strings.data(), strings.size() * sizeof(BinaryCacheString));
+    writeSection(header.stringDataOffset, stringData.data(), stringData.size());
+    writeSection(header.recordsOffset, records.data(), records.size() * sizeof(BinaryCacheRecord));
+    writeSection(header.otherInfoOffset, otherInfos.data(), otherInfos.size() * sizeof(BinaryCacheOtherInfo));
+    writeSection(header.indexOffset, index.data(), index.size() * sizeof(BinaryCacheIndexEntry));
+
+    if (codec) {
+        codec->writeFile(cachePath, fileData);
+        return;
+    }
+    std::ofstream ofs(cachePath, std::ios::binary);
+    if (!ofs.is_open()) {
+        throw std::runtime_error(std::format("无法写入文件 {}", wide2Ascii(cachePath)));
+    }
+    ofs.write(fileData.data(), fileData.size());
+}
+
+std::vector<Sentence> readCacheFile(const fs::path& cachePath, const ZstdCodec* codec) {
+    if (isSameExtension(cachePath, L".gtc")) {
+        return BinaryCache(cachePath, codec).readAll();
+    }
+    return readCacheJson(cachePath, codec);
+}
+
+void convertCacheFile(const fs::path& fromPath, const fs::path& toPath, const ZstdCodec* readCodec, const ZstdCodec* writeCodec) {
+    std::vector<Sentence> sentences = readCacheFile(fromPath, readCodec);
+    if (isSameExtension(toPath, L".gtc")) {
+        saveCacheBinary(sentences, toPath, writeCodec);
+    }
+    else {
+        saveCache(sentences, toPath, writeCodec);
+    }
+}
@@ -9,6 +9,8 @@ export module Dictionary;
 
 import <toml++/toml.hpp>;
 import Tool;
+import ResourceCache;
+import MeCabRegistry;
 
 namespace fs = std::filesystem;
 
@@ -27,10 +29,12 @@ export {
     private:
         std::vector<GptTabEntry> m_entries;
 
-        std::unique_ptr<MeCab::Model> m_model;
+        std::shared_ptr<MeCab::Model> m_model;
         std::unique_ptr<MeCab::Tagger> m_tagger;
         std::shared_ptr<spdlog::logger> m_logger;
 
+        std::vector<GptTabEntry> parseFile(const fs::path& filePath);
+
     public:
 
         GptDictionary(std::shared_ptr<spdlog::logger> logger) : m_logger(logger) {}
@@ -61,6 +65,9 @@ export {
         bool isConditional = false;
         std::shared_ptr<icu::RegexPattern> conditionReg;
         CachePart conditionTarget;
+
+        // 由词条内容计算，用于比较新旧字典的差异
+        uint64_t fingerprint = 0;
     };
 
     class NormalDictionary {
@@ -68,6 +75,12 @@ export {
         std::vector<DictEntry> m_entries;
         std::shared_ptr<spdlog::logger> m_logger;
 
+        bool conditionMatches(const DictEntry& entry, const Sentence* sentence);
+
+        bool searchMatches(const DictEntry& entry, const std::string& text);
+
+        std::vector<DictEntry> parseFile(const fs::path& filePath);
+
     public:
 
         NormalDictionary(std::shared_ptr<spdlog::logger> logger) : m_logger(logger) {}
@@ -76,7 +89,12 @@ export {
 
         void sort();
 
-        std::string doReplace(const Sentence* sentence, CachePart targetToModify);
+        /**
+        * @brief 依次应用所有词条，hitEntries 不为空时记录实际命中的词条指纹
+        */
+        std::string doReplace(const Sentence* sentence, CachePart targetToModify, std::vector<uint64_t>* hitEntries = nullptr);
+
+        std::vector<uint64_t> getFingerprints() const;
     };
 }
 
@@ -120,13 +138,8 @@ void GptDictionary::sort() {
 }
 
 void GptDictionary::createTagger(const fs::path& dictDir) {
-    m_model.reset(
-        MeCab::Model::create(("-r BaseConfig/DictGenerator/mecabrc -d " + wide2Ascii(dictDir, 0)).c_str())
-    );
-    if (!m_model) {
-        throw std::runtime_error("无法初始化 MeCab Model。请确保 BaseConfig/DictGenerator/mecabrc 和 " + wide2Ascii(dictDir) + " 存在\n"
-            "错误信息: " + MeCab::getLastError());
-    }
+    // 模型与 GenDict 等共享，Tagger::parse(Lattice*) 可以被多个翻译线程同时调用
+    m_model = MeCabRegistry::instance().acquire(dictDir);
     m_tagger.reset(m_model->createTagger());
     if (!m_tagger) {
         throw std::runtime_error("无法初始化 MeCab Tagger。请确保 BaseConfig/DictGenerator/mecabrc 和 " + wide2Ascii(dictDir) + " 存在\n"
@@ -206,15 +219,21 @@ void GptDictionary::loadFromFile(const fs::path& filePath) {
         return;
     }
 
+    bool fromCache = false;
+    auto entries = ResourceCache::instance().getOrLoad("gptDict", filePath, [&]() { return parseFile(filePath); }, &fromCache);
+    m_entries.insert(m_entries.end(), entries->begin(), entries->end());
+    m_logger->info("已加载 GPT 字典: {}, 共 {} 个词条{}", wide2Ascii(filePath.filename()), entries->size(), fromCache ? " (缓存)" : "");
+}
+
+std::vector<GptTabEntry> GptDictionary::parseFile(const fs::path& filePath) {
     std::ifstream ifs(filePath);
-    int count = 0;
+    std::vector<GptTabEntry> entries;
 
     try {
         auto dictData = toml::parse(ifs);
         auto dicts = dictData["gptDict"].as_array();
         if (!dicts) {
-            m_logger->info("已加载 GPT 字典: {}, 共 {} 个词条", wide2Ascii(filePath.filename()), count);
-            return;
+            return entries;
         }
         dicts->for_each([&](auto&& el)
             {
@@ -236,8 +255,7 @@ void GptDictionary::loadFromFile(const fs::path& filePath) {
                         entry.note = el["note"].value_or("");
                     }
                     entry.priority = el["priority"].value_or(0);
-                    m_entries.push_back(entry);
-                    count++;
+                    entries.push_back(entry);
                 }
                 else {
                     throw std::invalid_argument(std::format("GPT 字典文件格式错误(not a table): {}", wide2Ascii(filePath)));
@@ -248,8 +266,8 @@ void GptDictionary::loadFromFile(const fs::path& filePath) {
         m_logger->error("GPT 字典文件解析错误: {}, 错误位置: {}, 错误信息: {}", wide2Ascii(filePath), stream2String(e.source().begin), e.description());
         throw std::runtime_error(e.what());
     }
-    
-    m_logger->info("已加载 GPT 字典: {}, 共 {} 个词条", wide2Ascii(filePath.filename()), count);
+
+    return entries;
 }
 
 std::string GptDictionary::doReplace(const Sentence* se, CachePart targetToModify) {
@@ -338,14 +356,21 @@ void NormalDictionary::loadFromFile(const fs::path& filePath) {
         return;
     }
 
-    int count = 0;
+    // 编译好的正则由 shared_ptr 持有，缓存中的词条可以直接复制给多个字典使用
+    bool fromCache = false;
+    auto entries = ResourceCache::instance().getOrLoad("normalDict", filePath, [&]() { return parseFile(filePath); }, &fromCache);
+    m_entries.insert(m_entries.end(), entries->begin(), entries->end());
+    m_logger->info("已加载 Normal 字典: {}, 共 {} 个词条{}", wide2Ascii(filePath.filename()), entries->size(), fromCache ? " (缓存)" : "");
+}
+
+std::vector<DictEntry> NormalDictionary::parseFile(const fs::path& filePath) {
+    std::vector<DictEntry> entries;
     std::ifstream ifs(filePath);
     try {
         auto dictData = toml::parse(ifs);
         auto dicts = dictData["normalDict"].as_array();
         if (!dicts) {
-            m_logger->info("已加载 Normal 字典: {}, 共 {} 个词条", wide2Ascii(filePath.filename()), count);
-            return;
+            return entries;
         }
         dicts->for_each([&](auto&& el)
             {
@@ -379,10 +404,11 @@ void NormalDictionary::loadFromFile(const fs::path& filePath) {
                     entry.replaceStr = el.contains("rep") ? el["rep"].value_or("") : el["replaceStr"].value_or("");
                     entry.priority = el["priority"].value_or(0);
                     entry.isConditional = !(el["conditionTarget"].value_or(std::string{}).empty()) && !(el["conditionReg"].value_or(std::string{}).empty());
+                    entry.fingerprint = fnv1a64(std::format("{}\x1f{}\x1f{}\x1f{}\x1f{}\x1f{}", entry.isReg, str, entry.replaceStr, entry.priority,
+                        entry.isConditional ? el["conditionTarget"].value_or("") : "", entry.isConditional ? el["conditionReg"].value_or("") : ""));
 
                     if (!entry.isConditional) {
-                        m_entries.push_back(entry);
-                        count++;
+                        entries.push_back(entry);
                         return;
                     }
 
@@ -405,8 +431,7 @@ void NormalDictionary::loadFromFile(const fs::path& filePath) {
                             wide2Ascii(filePath), str));
                     }
 
-                    m_entries.push_back(entry);
-                    count++;
+                    entries.push_back(entry);
                 }
             });
     }
@@ -414,8 +439,8 @@ void NormalDictionary::loadFromFile(const fs::path& filePath) {
         m_logger->error("Normal 字典文件解析错误: {}, 错误位置: {}, 错误信息: {}", wide2Ascii(filePath), stream2String(e.source().begin), e.description());
         throw std::runtime_error(e.what());
     }
-    
-    m_logger->info("已加载 Normal 字典: {}, 共 {} 个词条", wide2Ascii(filePath.filename()), count);
+
+    return entries;
 }
 
 void NormalDictionary::sort() {
@@ -434,7 +459,40 @@ void NormalDictionary::sort() {
         });
 }
 
-std::string NormalDictionary::doReplace(const Sentence* sentence, CachePart targetToModify) {
+bool NormalDictionary::conditionMatches(const DictEntry& entry, const Sentence* sentence) {
+    if (!entry.isConditional) {
+        return true;
+    }
+    icu::UnicodeString textToInspect = icu::UnicodeString::fromUTF8(chooseString(sentence, entry.conditionTarget));
+    UErrorCode status = U_ZERO_ERROR;
+    std::unique_ptr<icu::RegexMatcher> matcher(entry.conditionReg->matcher(textToInspect, status));
+    if (U_FAILURE(status)) {
+        m_logger->error("正则表达式创建matcher失败: {}, 句子: [{}]", u_errorName(status), sentence->original_text);
+        return false;
+    }
+    return matcher->find();
+}
+
+bool NormalDictionary::searchMatches(const DictEntry& entry, const std::string& text) {
+    if (!entry.isReg) {
+        return text.find(entry.searchStr) != std::string::npos;
+    }
+    icu::UnicodeString ustr(icu::UnicodeString::fromUTF8(text));
+    UErrorCode status = U_ZERO_ERROR;
+    std::unique_ptr<icu::RegexMatcher> matcher(entry.searchReg->matcher(ustr, status));
+    return !U_FAILURE(status) && matcher->find();
+}
+
+std::vector<uint64_t> NormalDictionary::getFingerprints() const {
+    std::vector<uint64_t> fingerprints;
+    fingerprints.reserve(m_entries.size());
+    for (const auto& entry : m_entries) {
+        fingerprints.push_back(entry.fingerprint);
+    }
+    return fingerprints;
+}
+
+std::string NormalDictionary::doReplace(const Sentence* sentence, CachePart targetToModify, std::vector<uint64_t>* hitEntries) {
     std::string textToModify = chooseString(sentence, targetToModify);
 
     if (textToModify.empty()) {
@@ -442,20 +500,10 @@ std::string NormalDictionary::doReplace(const Sentence* sentence, CachePart targ
     }
 
     for (const auto& entry : m_entries) {
-        bool canReplace = false;
-        if (!entry.isConditional) {
-            canReplace = true;
-        }
-        else {
-            icu::UnicodeString textToInspect = icu::UnicodeString::fromUTF8(chooseString(sentence, entry.conditionTarget));
-            UErrorCode status = U_ZERO_ERROR;
-            std::unique_ptr<icu::RegexMatcher> matcher(entry.conditionReg->matcher(textToInspect, status));
-            if (!U_FAILURE(status)) {
-                canReplace = matcher->find();
-            }
-            else {
-                m_logger->error("正则表达式创建matcher失败: {}, 句子: [{}]", u_errorName(status), textToModify);
-            }
+        bool canReplace = conditionMatches(entry, sentence);
+
+        if (canReplace && hitEntries && searchMatches(entry, textToModify)) {
+            hitEntries->push_back(entry.fingerprint);
         }
 
         if (canReplace) {
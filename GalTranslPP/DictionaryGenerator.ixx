@@ -12,8 +12,11 @@ import <ctpl_stl.h>;
 import <toml++/toml.hpp>;
 import Tool;
 import APIPool;
+import UsageStatistics;
+import JsonReader;
 import Dictionary;
 import ITranslator;
+import MeCabRegistry;
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
@@ -22,6 +25,7 @@ export {
     class DictionaryGenerator {
     private:
         APIPool& m_apiPool;
+        UsageStatistics& m_usageStatistics;
         std::shared_ptr<IController> m_controller;
         std::string m_systemPrompt;
         std::string m_userPrompt;
@@ -34,7 +38,9 @@ export {
 
         // 阶段一和二的结果
         std::vector<std::string> m_segments;
-        std::vector<std::set<std::string>> m_segmentWords;
+        // 词语按字典序分配 id，每个文本块记录其中出现的词语 id (升序且不重复)
+        std::vector<std::string> m_words;
+        std::vector<std::vector<int>> m_segmentWords;
         std::map<std::string, int> m_wordCounter;
         std::set<std::string> m_nameSet;
 
@@ -43,15 +49,15 @@ export {
         std::map<std::string, int> m_finalCounter;
         std::mutex m_resultMutex;
 
-        // MeCab 解析器
-        std::unique_ptr<MeCab::Tagger> m_tagger;
+        // 与 GptDictionary 共享的 MeCab 模型
+        std::shared_ptr<MeCab::Model> m_mecabModel;
 
         void preprocessAndTokenize(const std::vector<fs::path>& jsonFiles, NormalDictionary& preDict, bool usePreDictInName);
         std::vector<int> solveSentenceSelection();
         void callLLMToGenerate(int segmentIndex, int threadId);
 
     public:
-        DictionaryGenerator(std::shared_ptr<IController> controller, std::shared_ptr<spdlog::logger> logger, APIPool& apiPool, const fs::path& dictDir,
+        DictionaryGenerator(std::shared_ptr<IController> controller, std::shared_ptr<spdlog::logger> logger, APIPool& apiPool, UsageStatistics& usageStatistics, const fs::path& dictDir,
             const std::string& systemPrompt, const std::string& userPrompt, const std::string& apiStrategy,
             int maxRetries, int threadsNum, int apiTimeoutMs, bool checkQuota);
         void generate(const fs::path& inputDir, const fs::path& outputFilePath, NormalDictionary& preDict, bool usePreDictInName);
@@ -62,42 +68,55 @@ export {
 module :private;
 
 DictionaryGenerator::DictionaryGenerator(std::shared_ptr<IController> controller, std::shared_ptr<spdlog::logger> logger, APIPool& apiPool,
-    const fs::path& dictDir, const std::string& systemPrompt, const std::string& userPrompt, const std::string& apiStrategy,
+    UsageStatistics& usageStatistics, const fs::path& dictDir, const std::string& systemPrompt, const std::string& userPrompt, const std::string& apiStrategy,
     int maxRetries, int threadsNum, int apiTimeoutMs, bool checkQuota)
-    : m_controller(controller), m_logger(logger), m_apiPool(apiPool), m_systemPrompt(systemPrompt), m_userPrompt(userPrompt),
+    : m_controller(controller), m_logger(logger), m_apiPool(apiPool), m_usageStatistics(usageStatistics), m_systemPrompt(systemPrompt), m_userPrompt(userPrompt),
     m_apiStrategy(apiStrategy), m_maxRetries(maxRetries), m_checkQuota(checkQuota),
     m_threadsNum(threadsNum), m_apiTimeoutMs(apiTimeoutMs) 
 {
-    m_tagger.reset(
-        MeCab::createTagger(("-r BaseConfig/DictGenerator/mecabrc -d " + wide2Ascii(dictDir, 0)).c_str())
-    );
-    if (!m_tagger) {
-        throw std::runtime_error("无法初始化 MeCab Tagger。请确保 BaseConfig/DictGenerator/mecabrc 和 " + wide2Ascii(dictDir) + " 存在且无特殊字符");
-    }
+    m_mecabModel = MeCabRegistry::instance().acquire(dictDir);
 }
 
 void DictionaryGenerator::preprocessAndTokenize(const std::vector<fs::path>& jsonFiles, NormalDictionary& preDict, bool usePreDictInName) {
     m_logger->info("阶段一：预处理和分词...");
-    std::string currentSegment;
     const size_t MAX_SEGMENT_LEN = 512;
-
-    Sentence se;
+    const size_t SEGMENTS_PER_TASK = 64;
+    int workersNum = std::max(1, (int)std::thread::hardware_concurrency());
+    ctpl::thread_pool pool(workersNum);
+
+    // 读取文件和应用译前字典按文件并行，之后按原顺序拼接成文本块，结果与逐个处理时相同
+    struct PreprocessedFile {
+        std::vector<std::string> names;
+        std::vector<std::string> lines;
+    };
+    std::vector<std::future<PreprocessedFile>> fileResults;
     for (const auto& filePath : jsonFiles) {
-        std::ifstream f(filePath);
-        json data = json::parse(f);
-        for (const auto& item : data) {
-            se.name = item.value("name", "");
-            se.original_text = item.value("message", "");
-            if (usePreDictInName) {
-                se.name = preDict.doReplace(&se, CachePart::Name);
-            }
-            se.original_text = preDict.doReplace(&se, CachePart::OrigText);
-            if (!se.name.empty()) {
-                m_nameSet.insert(se.name);
-                m_wordCounter[se.name] += 2;
-            }
-            currentSegment += se.name + se.original_text + "\n";
+        fileResults.emplace_back(pool.push([&, filePath](int)
+            {
+                PreprocessedFile result;
+                for (auto& se : readInputJson(filePath)) {
+                    if (usePreDictInName) {
+                        se.name = preDict.doReplace(&se, CachePart::Name);
+                    }
+                    se.original_text = preDict.doReplace(&se, CachePart::OrigText);
+                    if (!se.name.empty()) {
+                        result.names.push_back(se.name);
+                    }
+                    result.lines.push_back(se.name + se.original_text + "\n");
+                }
+                return result;
+            }));
+    }
 
+    std::string currentSegment;
+    for (auto& fileResult : fileResults) {
+        PreprocessedFile result = fileResult.get();
+        for (const auto& name : result.names) {
+            m_nameSet.insert(name);
+            m_wordCounter[name] += 2;
+        }
+        for (const auto& line : result.lines) {
+            currentSegment += line;
             if (currentSegment.length() > MAX_SEGMENT_LEN) {
                 m_segments.push_back(currentSegment);
                 currentSegment.clear();
@@ -109,26 +128,65 @@ void DictionaryGenerator::preprocessAndTokenize(const std::vector<fs::path>& jso
     }
 
     m_logger->info("共分割成 {} 个文本块，开始使用 MeCab 分词...", m_segments.size());
-    m_segmentWords.reserve(m_segments.size());
-    for (const auto& segment : m_segments) {
-        std::set<std::string> wordsInSegment;
-        const MeCab::Node* node = m_tagger->parseToNode(segment.c_str());
-        for (; node; node = node->next) {
-            if (node->stat == MECAB_BOS_NODE || node->stat == MECAB_EOS_NODE) continue;
-
-            std::string surface(node->surface, node->length);
-            std::string feature = node->feature;
-
-            m_logger->trace("分词结果：{} ({})", surface, feature);
+    // 每个线程从共享模型创建自己的分词器，词频先记在线程本地，最后再合并
+    std::vector<std::unique_ptr<MeCabTokenizer>> tokenizers(workersNum);
+    std::vector<std::map<std::string, int>> localCounters(workersNum);
+    std::vector<std::vector<std::string>> segmentSurfaces(m_segments.size());
+    std::vector<std::future<void>> tokenizeResults;
+    for (size_t begin = 0; begin < m_segments.size(); begin += SEGMENTS_PER_TASK) {
+        size_t end = std::min(begin + SEGMENTS_PER_TASK, m_segments.size());
+        tokenizeResults.emplace_back(pool.push([&, begin, end](int threadId)
+            {
+                if (!tokenizers[threadId]) {
+                    tokenizers[threadId] = std::make_unique<MeCabTokenizer>(m_mecabModel);
+                }
+                std::map<std::string, int>& counter = localCounters[threadId];
+                for (size_t i = begin; i < end; ++i) {
+                    std::vector<std::string>& wordsInSegment = segmentSurfaces[i];
+                    const MeCab::Node* node = tokenizers[threadId]->parse(m_segments[i]);
+                    for (; node; node = node->next) {
+                        if (node->stat == MECAB_BOS_NODE || node->stat == MECAB_EOS_NODE) continue;
+
+                        std::string surface(node->surface, node->length);
+                        std::string feature = node->feature;
+
+                        m_logger->trace("分词结果：{} ({})", surface, feature);
+
+                        if (surface.length() <= 1) continue;
+
+                        if (feature.find("固有名詞") != std::string::npos || containsKatakana(surface)) {
+                            counter[surface]++;
+                            wordsInSegment.push_back(std::move(surface));
+                        }
+                    }
+                    std::ranges::sort(wordsInSegment);
+                    wordsInSegment.erase(std::unique(wordsInSegment.begin(), wordsInSegment.end()), wordsInSegment.end());
+                }
+            }));
+    }
+    for (auto& res : tokenizeResults) {
+        res.get();
+    }
 
-            if (surface.length() <= 1) continue;
+    for (const auto& counter : localCounters) {
+        for (const auto& [word, count] : counter) {
+            m_wordCounter[word] += count;
+        }
+    }
 
-            if (feature.find("固有名詞") != std::string::npos || containsKatakana(surface)) {
-                wordsInSegment.insert(surface);
-                m_wordCounter[surface]++;
-            }
+    // m_wordCounter 已按字典序排列，按此顺序分配 id，升序的 id 列表与原先有序的词语集合一一对应
+    std::unordered_map<std::string_view, int> wordIds;
+    m_words.reserve(m_wordCounter.size());
+    for (const auto& [word, count] : m_wordCounter) {
+        wordIds.emplace(word, (int)m_words.size());
+        m_words.push_back(word);
+    }
+    m_segmentWords.resize(m_segments.size());
+    for (size_t i = 0; i < m_segments.size(); ++i) {
+        m_segmentWords[i].reserve(segmentSurfaces[i].size());
+        for (const auto& surface : segmentSurfaces[i]) {
+            m_segmentWords[i].push_back(wordIds.at(surface));
         }
-        m_segmentWords.push_back(wordsInSegment);
     }
 }
 
@@ -136,55 +194,71 @@ std::vector<int> DictionaryGenerator::solveSentenceSelection() {
     m_logger->info("阶段二：搜索并选择信息量最大的文本块...");
 
     // 剔除出现次数小于2的词语，人名除外
-    std::set<std::string> allWords;
-    for (const auto& [word, count] : m_wordCounter) {
-        if (count >= 2 || m_nameSet.count(word)) {
-            allWords.insert(word);
+    std::vector<char> isCandidate(m_words.size(), 0);
+    size_t candidateCount = 0;
+    for (size_t id = 0; id < m_words.size(); ++id) {
+        if (m_wordCounter[m_words[id]] >= 2 || m_nameSet.count(m_words[id])) {
+            isCandidate[id] = 1;
+            candidateCount++;
         }
     }
 
-    // 过滤每个 segment 中的词，只保留在 allWords 中的
-    std::vector<std::set<std::string>> filteredSegmentWords;
+    // 过滤每个 segment 中的词，只保留候选词
+    std::vector<std::vector<int>> filteredSegmentWords;
+    filteredSegmentWords.reserve(m_segmentWords.size());
     for (const auto& segment : m_segmentWords) {
-        std::set<std::string> filteredSet;
-        std::set_intersection(segment.begin(), segment.end(),
-            allWords.begin(), allWords.end(),
-            std::inserter(filteredSet, filteredSet.begin()));
-        filteredSegmentWords.push_back(filteredSet);
+        std::vector<int> filtered;
+        for (int id : segment) {
+            if (isCandidate[id]) {
+                filtered.push_back(id);
+            }
+        }
+        filteredSegmentWords.push_back(std::move(filtered));
     }
 
-    std::set<std::string> coveredWords;
+    std::vector<char> isCovered(m_words.size(), 0);
+    size_t coveredCount = 0;
     std::vector<int> selectedIndices;
-    std::vector<int> remainingIndices(filteredSegmentWords.size());
-    std::iota(remainingIndices.begin(), remainingIndices.end(), 0);
-
-    while (coveredWords.size() < allWords.size() && !remainingIndices.empty()) {
-        int bestIndex = -1;
-        size_t maxNewCoverage = 0;
-
-        for (int index : remainingIndices) {
-            std::set<std::string> tempSet;
-            std::set_difference(
-                filteredSegmentWords[index].begin(), filteredSegmentWords[index].end(),
-                coveredWords.begin(), coveredWords.end(),
-                std::inserter(tempSet, tempSet.begin())
-            );
-            size_t newCoverage = tempSet.size();
-
-            if (newCoverage > maxNewCoverage) {
-                maxNewCoverage = newCoverage;
-                bestIndex = index;
+    auto countNewCoverage = [&](int index)
+        {
+            return (size_t)std::ranges::count_if(filteredSegmentWords[index], [&](int id) { return !isCovered[id]; });
+        };
+
+    // 惰性贪心：已覆盖的词只会增多，堆中记录的收益只可能偏高
+    // 堆顶重新计算后收益不变，就一定是当前收益最大的块；收益相同时取序号较小的，与逐个比较时的选择一致
+    using Candidate = std::pair<size_t, int>;
+    auto lessPromising = [](const Candidate& a, const Candidate& b)
+        {
+            if (a.first != b.first) {
+                return a.first < b.first;
             }
+            return a.second > b.second;
+        };
+    std::priority_queue<Candidate, std::vector<Candidate>, decltype(lessPromising)> heap(lessPromising);
+    for (int index = 0; index < (int)filteredSegmentWords.size(); ++index) {
+        if (!filteredSegmentWords[index].empty()) {
+            heap.emplace(filteredSegmentWords[index].size(), index);
         }
+    }
 
-        if (bestIndex != -1) {
-            coveredWords.insert(filteredSegmentWords[bestIndex].begin(), filteredSegmentWords[bestIndex].end());
-            selectedIndices.push_back(bestIndex);
-            remainingIndices.erase(std::remove(remainingIndices.begin(), remainingIndices.end(), bestIndex), remainingIndices.end());
+    while (coveredCount < candidateCount && !heap.empty()) {
+        auto [staleCoverage, index] = heap.top();
+        heap.pop();
+        size_t newCoverage = countNewCoverage(index);
+        if (newCoverage == 0) {
+            continue;
         }
-        else {
-            break;
+        if (newCoverage < staleCoverage) {
+            heap.emplace(newCoverage, index);
+            continue;
+        }
+        for (int id : filteredSegmentWords[index]) {
+            if (!isCovered[id]) {
+                isCovered[id] = 1;
+                coveredCount++;
+            }
         }
+        selectedIndices.push_back(index);
     }
     return selectedIndices;
 }
@@ -229,6 +303,7 @@ void DictionaryGenerator::callLLMToGenerate(int segmentIndex, int threadId) {
 
         m_logger->info("[线程 {}] 开始从段落中生成术语表\ninputBlock: \n{}", threadId, text);
         ApiResponse response = performApiRequest(payload, currentAPI, threadId, m_controller, m_logger, m_apiTimeoutMs);
+        m_usageStatistics.record(currentAPI, "GenDict", retryCount == 0 ? "首次请求" : "重试", response);
 
         if (response.success) {
             m_logger->info("[线程 {}] AI 字典生成成功:\n {}", threadId, response.content);
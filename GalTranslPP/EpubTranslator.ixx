@@ -1,26 +1,33 @@
 module;
 
 #include <spdlog/spdlog.h>
+#include <gumbo.h>
 #include <unicode/regex.h>
 #include <unicode/unistr.h>
 #include <zip.h>
-#include <gumbo.h>
 
 export module EpubTranslator;
 
 import <nlohmann/json.hpp>;
 import <toml++/toml.hpp>;
+import <ctpl_stl.h>;
 import Tool;
+import JsonReader;
+import HtmlEntities;
 import NormalJsonTranslator;
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
 
+// 异常退出时丢弃未关闭的存档，正常写出时需先 zip_close 再 release
+using ZipHandle = std::unique_ptr<zip_t, decltype(&zip_discard)>;
+
 export {
 
     struct EpubTextNodeInfo {
         size_t offset; // 节点在原始文件中的字节偏移量
         size_t length; // 节点内容的字节长度
+        int sharedIndex = -1; // 跨章节去重后在本书共用 json 中的序号，-1 表示在章节自己的 json 中
     };
 
     struct CallbackPattern {
@@ -42,26 +49,46 @@ export {
 
         fs::path m_epubInputDir;
         fs::path m_epubOutputDir;
-        fs::path m_tempUnpackDir;
-        fs::path m_tempRebuildDir;
 
         // EPUB 处理相关的配置
         bool m_bilingualOutput;
         std::string m_originalTextColor;
         std::string m_originalTextScale;
+        // 是否在项目目录下保存预处理后和重组后的 HTML (epub_show_normal / epub_show_normal_post)，用于调试正则
+        bool m_saveIntermediateHtml = true;
+        // 同一本书中至少出现在这么多个章节里的文本节点只翻译一次，0 表示不去重
+        int m_dedupMinChapters = 0;
+        std::atomic<size_t> m_dedupSavedNodes = 0;
+        std::atomic<size_t> m_dedupSavedTokens = 0;
+        // 同时用 Gumbo 解析每个章节并与流式提取的结果逐节点对照，不一致时记录并改用 Gumbo 的结果
+        bool m_compareWithGumbo = false;
+        std::atomic<size_t> m_gumboComparedChapters = 0;
+        std::atomic<size_t> m_gumboMismatchedChapters = 0;
+
+        // 影响提取结果(预处理正则)和重组结果(后处理正则、双语显示设置)的配置的哈希，记入每本书的清单
+        uint64_t m_epubExtractHash = 0;
+        uint64_t m_epubRebuildHash = 0;
 
         // 预处理正则和后处理正则
         std::vector<RegexPattern> m_preRegexPatterns;
         std::vector<RegexPattern> m_postRegexPatterns;
 
+        // 每条正则的累计耗时(纳秒)，仅在 debug 日志级别下统计，运行结束时输出，便于找出代价高的正则
+        std::vector<std::atomic<int64_t>> m_preRegexCostNs;
+        std::vector<std::atomic<int64_t>> m_postRegexCostNs;
+
 
         // 存储json文件相对路径到句子元数据的映射
         // Key: json文件相对路径 (e.g., "dir1/book1/OEBPS/chapter1.json")
         // Value: 元数据
         std::map<fs::path, std::vector<EpubTextNodeInfo>> m_jsonToMetadataMap;
 
-        // 存储json文件相对路径到原始HTML完整路径的映射
-        std::map<fs::path, fs::path> m_jsonToHtmlPathMap;
+        // 存储json文件相对路径到预处理正则替换后的HTML的映射，元数据中的偏移都相对于这份内容
+        // 重组时直接使用，不再重新读取原始条目并再跑一遍预处理正则，重组后即释放
+        std::map<fs::path, std::string> m_jsonToPreprocessedHtmlMap;
+
+        // 存储json文件相对路径到原始HTML在epub中的条目名的映射
+        std::map<fs::path, std::string> m_jsonToHtmlEntryMap;
 
         // 存储json文件相对路径到其所属epub完整路径的映射
         std::map<fs::path, fs::path> m_jsonToEpubPathMap;
@@ -72,6 +99,118 @@ export {
         // 每个epub完整路径对应的多个json文件相对路径以及有没有处理完毕
         std::map<fs::path, std::map<fs::path, bool>> m_epubToJsonsMap;
 
+        // 每个epub完整路径对应的跨章节共用文本 json 的相对路径，没有去重时不存在
+        std::map<fs::path, fs::path> m_epubToSharedJsonMap;
+
+        // 提取结果取自清单、内容尚未经过预处理正则的章节，需要重组时再做预处理
+        std::set<fs::path> m_rawHtmlJsons;
+
+        // 已登记但还没有打包的书中，HTML 留在内存里的书
+        // 这样的书达到 CPU 线程池的大小后，再登记的书把 HTML 暂存到磁盘，重组时再读回，
+        // 提取比翻译快得多，不这样做整个书库的 HTML 都会在翻译开始后不久进入内存
+        std::set<fs::path> m_inMemoryHtmlEpubs;
+        std::map<fs::path, fs::path> m_jsonToSpilledHtmlMap;
+        fs::path m_htmlSpillDir;
+
+        // 每本书上一次运行写出的清单，以及本次运行正在生成的清单
+        // 清单记录各章节原始内容和译文的哈希，以及输出 EPUB 的大小和修改时间
+        // 提取出的文本节点数量和 HTML 相当，在登记时就单独写进 nodes 文件，不留在内存中
+        struct BookManifest {
+            json previous; // 不存在或无法解析时为 null
+            json current;
+        };
+        std::map<fs::path, std::shared_ptr<BookManifest>> m_epubToManifestMap;
+
+        // 上面几个映射由生产者线程写入、由翻译线程在文件完成时读取
+        std::mutex m_epubMapsMutex;
+
+        struct ExtractedChapter {
+            std::string entryName;
+            fs::path relJsonPath;
+            fs::path showNormalPostHtmlPath;
+            std::vector<EpubTextNodeInfo> metadata;
+            std::vector<std::string> texts; // 各文本节点的内容，写出输入 json 后清空
+            std::string content;
+            uint64_t sourceHash = 0; // 原始条目内容的哈希
+            bool preprocessed = true; // content 是否已经过预处理正则
+            fs::path spilledHtmlPath; // content 暂存到磁盘时的路径，此时 content 为空
+        };
+
+        // 一本书的重组状态，各章节在 CPU 线程池中并行重组，最后完成的章节负责打包
+        struct BookRebuild {
+            fs::path epubPath;
+            std::mutex mutex;
+            // 重组后的章节，各自已在章节的任务中压缩进内存中的 zip
+            std::map<std::string, ZipHandle> replacedEntries;
+            std::atomic<int64_t> compressNs = 0;
+            std::atomic<size_t> remainingChapters = 0;
+            // 跨章节共用文本的译文，由第一个用到它的章节读取
+            fs::path sharedJsonPath;
+            std::once_flag sharedOnce;
+            std::vector<Sentence> sharedTranslations;
+            std::shared_ptr<BookManifest> manifest;
+            // 上次的输出仍然有效时以它为底本，只替换原文或译文有变化的章节
+            bool updatePrevious = false;
+        };
+
+        // 提取、重组和打包都是纯 CPU 工作，放在独立的线程池中，翻译线程只负责请求 API
+        std::unique_ptr<ctpl::thread_pool> m_cpuPool;
+        std::mutex m_rebuildResultsMutex;
+        std::vector<std::future<void>> m_rebuildResults;
+
+        /**
+        * @brief 以 epubPath 为底本写出 outputEpubPath，replacedEntries 中的条目替换为新内容，
+        * 所有条目都按压缩后的数据直接复制，zip_close 时不再压缩任何内容
+        */
+        void packEpub(const fs::path& epubPath, const fs::path& outputEpubPath, const std::map<std::string, ZipHandle>& replacedEntries);
+
+        /**
+        * @brief 按顺序执行 regexPatterns，每条正则一遍，UTF-8 和 UnicodeString 之间只转换一次
+        * 各遍共用两块轮换的缓冲区，回调正则的 matcher 在一遍内复用
+        */
+        void regexReplace(const std::vector<RegexPattern>& regexPatterns, std::vector<std::atomic<int64_t>>& costNs, std::string& content);
+
+        void logRegexCost(const std::string& kind, const std::vector<RegexPattern>& regexPatterns, const std::vector<std::atomic<int64_t>>& costNs);
+
+        /**
+        * @brief 对一个章节做预处理正则并提取文本节点，写出 show_normal 文件，没有可翻译文本时 metadata 为空
+        * previousChapters 中有原始内容相同的记录时直接取用其中的文本节点，不跑预处理正则也不解析
+        */
+        ExtractedChapter extractChapter(const fs::path& relBookDir, std::string entryName, std::string content, const json* previousChapters);
+
+        /**
+        * @brief 按节点顺序取出一个章节的译文，去重的节点从本书的共用译文中取
+        * translatedData 接收章节自己的输出 json，返回的指针指向它和 book.sharedTranslations
+        */
+        std::vector<const std::string*> collectTranslations(const ExtractedChapter& chapter, BookRebuild& book, std::vector<Sentence>& translatedData);
+
+        /**
+        * @brief 用翻译结果重组一个章节，写出 show_normal_post 文件并返回新内容
+        */
+        std::string rebuildChapter(const ExtractedChapter& chapter, const std::vector<const std::string*>& translatedTexts);
+
+        /**
+        * @brief 找出一本书中在至少 m_dedupMinChapters 个章节里重复出现的文本节点，
+        * 把它们从各章节中取出，按首次出现的顺序放进共用文本列表，并在元数据中记下序号
+        */
+        std::vector<std::string> dedupBookChapters(std::vector<ExtractedChapter>& chapters);
+
+        void writeInputJson(const fs::path& relJsonPath, const std::vector<std::string>& texts);
+
+        /**
+        * @brief 每本书的清单 epub_manifest/dir1/book1.json，以及提取结果 epub_manifest/dir1/book1.nodes.json
+        */
+        fs::path getBookManifestPath(const fs::path& relBookDir, const std::wstring& suffix = L".json");
+
+        json loadManifestFile(const fs::path& manifestPath);
+
+        /**
+        * @brief 上次的清单与本次的设置、原书条目一致，且上次输出的 EPUB 未被改动时，才能在它的基础上只替换变化的章节
+        */
+        bool canUpdatePreviousOutput(const BookRebuild& book, const fs::path& outputEpubPath);
+
+        void packBook(BookRebuild& book);
+
     public:
 
         virtual void run() override;
@@ -89,7 +228,358 @@ export {
 
 module :private;
 
-// 递归遍历 Gumbo 树以提取文本节点
+// 提取或清单格式变化时递增，旧版本的清单整体作废
+constexpr int epubManifestVersion = 2;
+
+ZipHandle openZipForRead(const fs::path& zipPath) {
+    int error = 0;
+    zip_t* za = zip_open(wide2Ascii(zipPath).c_str(), ZIP_RDONLY, &error);
+    if (!za) {
+        throw std::runtime_error(std::format("无法打开 EPUB (zip) 文件 {}，错误码: {}", wide2Ascii(zipPath), error));
+    }
+    return ZipHandle(za, &zip_discard);
+}
+
+std::string readZipEntry(zip_t* za, zip_uint64_t index) {
+    zip_stat_t st;
+    zip_stat_init(&st);
+    if (zip_stat_index(za, index, 0, &st) < 0) {
+        throw std::runtime_error(std::format("无法读取 zip 条目信息: {}", zip_strerror(za)));
+    }
+    zip_file_t* zf = zip_fopen_index(za, index, 0);
+    if (!zf) {
+        throw std::runtime_error(std::format("无法打开 zip 条目 {}: {}", st.name, zip_strerror(za)));
+    }
+    std::string content(st.size, '\0');
+    zip_int64_t bytesRead = zip_fread(zf, content.data(), st.size);
+    zip_fclose(zf);
+    if (bytesRead < 0 || (zip_uint64_t)bytesRead != st.size) {
+        throw std::runtime_error(std::format("读取 zip 条目 {} 失败", st.name));
+    }
+    return content;
+}
+
+bool isHtmlEntry(const std::string& entryName) {
+    return isSameExtension(ascii2Wide(entryName), L".html") || isSameExtension(ascii2Wide(entryName), L".xhtml");
+}
+
+bool isCompressedMedia(const std::string& entryName) {
+    fs::path entryPath = ascii2Wide(entryName);
+    for (const wchar_t* ext : { L".jpg", L".jpeg", L".png", L".gif", L".webp", L".woff", L".woff2" }) {
+        if (isSameExtension(entryPath, ext)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+* @brief 把一个条目单独压缩进内存中的 zip，返回以只读方式打开的这个 zip，条目序号为 0
+* 各章节在自己的任务中并行压缩，打包时再用 ZIP_FL_COMPRESSED 原样复制压缩后的数据
+* 本身已经压缩过的图片和字体直接存储，不再 deflate
+*/
+ZipHandle compressEntry(const std::string& entryName, const std::string& content) {
+    zip_error_t error;
+    zip_error_init(&error);
+    auto takeErrorMessage = [&]()
+        {
+            std::string message = zip_error_strerror(&error);
+            zip_error_fini(&error);
+            return message;
+        };
+    std::unique_ptr<zip_source_t, decltype(&zip_source_free)> buffer(zip_source_buffer_create(nullptr, 0, 0, &error), &zip_source_free);
+    if (!buffer) {
+        throw std::runtime_error(std::format("无法为 {} 创建内存缓冲区: {}", entryName, takeErrorMessage()));
+    }
+    // 写出后还要以只读方式重新打开，写入用的存档另外持有一个引用，zip_close 时只释放那一个
+    zip_source_keep(buffer.get());
+    ZipHandle writer(zip_open_from_source(buffer.get(), ZIP_TRUNCATE, &error), &zip_discard);
+    if (!writer) {
+        zip_source_free(buffer.get());
+        throw std::runtime_error(std::format("无法为 {} 创建内存中的 zip: {}", entryName, takeErrorMessage()));
+    }
+    zip_source_t* s = zip_source_buffer(writer.get(), content.data(), content.size(), 0);
+    if (!s) {
+        throw std::runtime_error(std::format("无法为文件 {} 创建 zip source: {}", entryName, zip_strerror(writer.get())));
+    }
+    zip_int64_t idx = zip_file_add(writer.get(), entryName.c_str(), s, ZIP_FL_ENC_UTF_8);
+    if (idx < 0) {
+        zip_source_free(s);
+        throw std::runtime_error(std::format("无法将文件 {} 添加到 zip: {}", entryName, zip_strerror(writer.get())));
+    }
+    if (zip_set_file_compression(writer.get(), idx, isCompressedMedia(entryName) ? ZIP_CM_STORE : ZIP_CM_DEFLATE, 0) < 0) {
+        throw std::runtime_error(std::format("无法设置文件 {} 的压缩方式: {}", entryName, zip_strerror(writer.get())));
+    }
+    if (zip_close(writer.get()) < 0) {
+        throw std::runtime_error(std::format("压缩文件 {} 时出错: {}", entryName, zip_strerror(writer.get())));
+    }
+    writer.release();
+
+    ZipHandle reader(zip_open_from_source(buffer.get(), ZIP_RDONLY, &error), &zip_discard);
+    if (!reader) {
+        throw std::runtime_error(std::format("无法打开压缩后的 {}: {}", entryName, takeErrorMessage()));
+    }
+    buffer.release();
+    return reader;
+}
+
+bool isAsciiAlpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+bool isHtmlSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+void appendUtf8(std::string& out, uint32_t cp) {
+    if (cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        cp = 0xFFFD;
+    }
+    if (cp < 0x80) {
+        out += (char)cp;
+    }
+    else if (cp < 0x800) {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000) {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    else {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+/**
+* @brief 解码 content[pos] 处以 & 开头的字符引用并追加到 out，返回引用之后的位置
+* 命名实体使用 HTML5 的完整实体表，无法识别时 & 按原样保留，这与 HTML 的处理一致
+*/
+size_t decodeCharRef(const std::string& content, size_t pos, std::string& out) {
+    // 数字引用落在 0x80-0x9F 时按 windows-1252 解释，0 表示保持原码点
+    static constexpr uint16_t windows1252[32] = {
+        0x20AC, 0, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0, 0x017D, 0,
+        0, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0, 0x017E, 0x0178,
+    };
+
+    size_t n = content.size();
+    size_t p = pos + 1;
+    if (p < n && content[p] == '#') {
+        bool hex = p + 1 < n && (content[p + 1] == 'x' || content[p + 1] == 'X');
+        size_t digitsStart = p + (hex ? 2 : 1);
+        size_t q = digitsStart;
+        uint64_t cp = 0;
+        while (q < n && (hex ? std::isxdigit((unsigned char)content[q]) : std::isdigit((unsigned char)content[q]))) {
+            char d = (char)std::tolower((unsigned char)content[q]);
+            uint64_t digit = d <= '9' ? d - '0' : d - 'a' + 10;
+            // 超出范围的码点最终都会替换成 U+FFFD，这里只需防止溢出
+            cp = std::min<uint64_t>(cp * (hex ? 16 : 10) + digit, 0x110000);
+            ++q;
+        }
+        if (q == digitsStart) {
+            out += '&';
+            return pos + 1;
+        }
+        if (cp >= 0x80 && cp <= 0x9F && windows1252[cp - 0x80] != 0) {
+            cp = windows1252[cp - 0x80];
+        }
+        appendUtf8(out, (uint32_t)cp);
+        return q < n && content[q] == ';' ? q + 1 : q;
+    }
+
+    auto [nameLength, utf8] = matchNamedCharRef(std::string_view(content).substr(p));
+    if (nameLength == 0) {
+        out += '&';
+        return pos + 1;
+    }
+    out += utf8;
+    return p + nameLength;
+}
+
+/**
+* @brief 从 pos 开始找到标签结束的 >，属性值中引号内的 > 不算
+*/
+size_t findTagEnd(const std::string& content, size_t pos) {
+    char quote = 0;
+    bool afterEquals = false;
+    for (size_t i = pos; i < content.size(); ++i) {
+        char c = content[i];
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+            }
+            continue;
+        }
+        if (c == '>') {
+            return i;
+        }
+        if ((c == '"' || c == '\'') && afterEquals) {
+            quote = c;
+            afterEquals = false;
+            continue;
+        }
+        if (c == '=') {
+            afterEquals = true;
+        }
+        else if (!isHtmlSpace(c)) {
+            afterEquals = false;
+        }
+    }
+    return std::string::npos;
+}
+
+/**
+* @brief 找到 tagName 元素的结束标签(不区分大小写)，返回其 < 的位置，找不到时返回 content 的长度
+*/
+size_t findClosingTag(const std::string& content, size_t pos, const std::string& tagName) {
+    size_t n = content.size();
+    for (size_t i = content.find("</", pos); i != std::string::npos; i = content.find("</", i + 2)) {
+        size_t nameEnd = i + 2 + tagName.size();
+        if (nameEnd > n) {
+            break;
+        }
+        bool matched = std::equal(tagName.begin(), tagName.end(), content.begin() + i + 2, [](char a, char b)
+            {
+                return a == std::tolower((unsigned char)b);
+            });
+        if (matched && (nameEnd == n || isHtmlSpace(content[nameEnd]) || content[nameEnd] == '/' || content[nameEnd] == '>')) {
+            return i;
+        }
+    }
+    return n;
+}
+
+/**
+* @brief 不建 DOM，按 HTML 分词规则顺序扫描一遍，按文档顺序(也就是偏移顺序)收集文本节点
+* 文本节点的划分、字符引用的解码和换行的规范化都与原先基于 Gumbo 的提取一致，
+* offset 是节点第一个字符在 content 中的字节偏移，length 是解码后文本的字节长度
+* script 和 style 的内容跳过，title 和 textarea 的内容不解析标签，
+* xmp、iframe、noembed、noframes 和 plaintext 的内容既不解析标签也不解码字符引用
+*/
+void extractTextNodes(const std::string& content, std::vector<std::pair<std::string, EpubTextNodeInfo>>& sentences) {
+    // 对应 HTML 分词器的 DATA、RCDATA 和 RAWTEXT 状态
+    enum class TextMode { Data, RcData, RawText };
+
+    size_t n = content.size();
+    size_t pos = 0;
+    std::string text;
+    size_t textStart = std::string::npos;
+
+    auto flushText = [&]()
+        {
+            if (textStart == std::string::npos) {
+                return;
+            }
+            if (text.find_first_not_of(" \t\n\r") != std::string::npos) {
+                EpubTextNodeInfo info;
+                info.offset = textStart;
+                info.length = text.length();
+                sentences.push_back({ std::move(text), info });
+            }
+            text.clear();
+            textStart = std::string::npos;
+        };
+    auto consumeTextChar = [&](TextMode mode)
+        {
+            if (textStart == std::string::npos) {
+                textStart = pos;
+            }
+            char c = content[pos];
+            if (c == '&' && mode != TextMode::RawText) {
+                pos = decodeCharRef(content, pos, text);
+            }
+            else if (c == '\r') {
+                text += '\n';
+                pos += pos + 1 < n && content[pos + 1] == '\n' ? 2 : 1;
+            }
+            else if (c == '\0') {
+                // 正文中的 NUL 会被丢弃，RCDATA 和 RAWTEXT 中的则替换成 U+FFFD
+                if (mode != TextMode::Data) {
+                    appendUtf8(text, 0xFFFD);
+                }
+                ++pos;
+            }
+            else {
+                text += c;
+                ++pos;
+            }
+        };
+    auto skipPast = [&](size_t end, size_t skipLength)
+        {
+            pos = end == std::string::npos ? n : end + skipLength;
+        };
+
+    while (pos < n) {
+        if (content[pos] != '<' || pos + 1 >= n) {
+            consumeTextChar(TextMode::Data);
+            continue;
+        }
+        char next = content[pos + 1];
+        if (next == '!' || next == '?') {
+            // 注释、DOCTYPE、CDATA 和处理指令都不产生文本节点
+            flushText();
+            if (content.compare(pos, 4, "<!--") == 0) {
+                skipPast(content.find("-->", pos + 4), 3);
+            }
+            else {
+                skipPast(content.find('>', pos + 2), 1);
+            }
+        }
+        else if (next == '/') {
+            flushText();
+            if (pos + 2 < n && content[pos + 2] == '>') {
+                pos += 3;
+            }
+            else {
+                skipPast(pos + 2 < n && isAsciiAlpha(content[pos + 2]) ? findTagEnd(content, pos + 2) : content.find('>', pos + 2), 1);
+            }
+        }
+        else if (isAsciiAlpha(next)) {
+            flushText();
+            size_t nameEnd = pos + 1;
+            while (nameEnd < n && !isHtmlSpace(content[nameEnd]) && content[nameEnd] != '/' && content[nameEnd] != '>') {
+                ++nameEnd;
+            }
+            std::string tagName = content.substr(pos + 1, nameEnd - pos - 1);
+            std::ranges::transform(tagName, tagName.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+            skipPast(findTagEnd(content, nameEnd), 1);
+            // 紧跟在这几个开始标签后的第一个换行不属于内容
+            if ((tagName == "pre" || tagName == "listing" || tagName == "textarea") && pos < n) {
+                if (content[pos] == '\n') {
+                    ++pos;
+                }
+                else if (content[pos] == '\r') {
+                    pos += pos + 1 < n && content[pos + 1] == '\n' ? 2 : 1;
+                }
+            }
+            // 和 HTML 解析器一样，下面这些元素即使写成自闭合形式也会一直读到结束标签
+            if (tagName == "script" || tagName == "style") {
+                pos = findClosingTag(content, pos, tagName);
+            }
+            else if (tagName == "title" || tagName == "textarea" ||
+                tagName == "xmp" || tagName == "iframe" || tagName == "noembed" || tagName == "noframes" || tagName == "plaintext")
+            {
+                TextMode mode = tagName == "title" || tagName == "textarea" ? TextMode::RcData : TextMode::RawText;
+                // plaintext 没有结束标签，之后的全部内容都是文本
+                size_t close = tagName == "plaintext" ? n : findClosingTag(content, pos, tagName);
+                while (pos < close) {
+                    consumeTextChar(mode);
+                }
+                flushText();
+            }
+        }
+        else {
+            consumeTextChar(TextMode::Data);
+        }
+    }
+    flushText();
+}
+
+// 递归遍历 Gumbo 树以提取文本节点，仅用于和流式提取对照
 void extractTextNodes(GumboNode* node, std::vector<std::pair<std::string, EpubTextNodeInfo>>& sentences) {
     if (node->type == GUMBO_NODE_TEXT) {
         std::string text = node->v.text.text;
@@ -115,15 +605,12 @@ void extractTextNodes(GumboNode* node, std::vector<std::pair<std::string, EpubTe
 
 EpubTranslator::EpubTranslator(const fs::path& projectDir, std::shared_ptr<IController> controller, std::shared_ptr<spdlog::logger> logger) :
     NormalJsonTranslator(projectDir, controller, logger,
-        // m_inputDir                                                m_inputCacheDir
-        // m_outputDir                                               m_outputCacheDir
-        L"cache" / projectDir.filename() / L"epub_json_input", L"cache" / projectDir.filename() / L"gt_input_cache",
-        L"cache" / projectDir.filename() / L"epub_json_output", L"cache" / projectDir.filename() / L"gt_output_cache")
+        // m_inputDir                                            m_outputDir
+        L"cache" / projectDir.filename() / L"epub_json_input", L"cache" / projectDir.filename() / L"epub_json_output")
 {
     m_epubInputDir = m_projectDir / L"gt_input";
     m_epubOutputDir = m_projectDir / L"gt_output";
-    m_tempUnpackDir = L"cache" / m_projectDir.filename() / L"epub_unpacked";
-    m_tempRebuildDir = L"cache" / m_projectDir.filename() / L"epub_rebuild";
+    m_htmlSpillDir = L"cache" / projectDir.filename() / L"epub_html_spill";
 
     std::ifstream ifs;
 
@@ -139,6 +626,16 @@ EpubTranslator::EpubTranslator(const fs::path& projectDir, std::shared_ptr<ICont
         m_bilingualOutput = parseToml<bool>(projectConfig, pluginConfig, "plugins.Epub.双语显示");
         m_originalTextColor = parseToml<std::string>(projectConfig, pluginConfig, "plugins.Epub.原文颜色");
         m_originalTextScale = std::to_string(parseToml<double>(projectConfig, pluginConfig, "plugins.Epub.缩小比例"));
+        m_saveIntermediateHtml = projectConfig["plugins"]["Epub"]["保存中间HTML"].value_or(pluginConfig["plugins"]["Epub"]["保存中间HTML"].value_or(true));
+        // ShowNormal 模式的产物就是这些中间文件
+        if (m_transEngine == TransEngine::ShowNormal) {
+            m_saveIntermediateHtml = true;
+        }
+        m_dedupMinChapters = projectConfig["plugins"]["Epub"]["跨章节去重"].value_or(pluginConfig["plugins"]["Epub"]["跨章节去重"].value_or(0));
+        if (m_dedupMinChapters == 1) {
+            throw std::invalid_argument("plugins.Epub.跨章节去重 须为 0 (关闭) 或不小于 2 的章节数");
+        }
+        m_compareWithGumbo = projectConfig["plugins"]["Epub"]["对照Gumbo提取"].value_or(pluginConfig["plugins"]["Epub"]["对照Gumbo提取"].value_or(false));
 
         auto readRegexArr = [](const toml::array& regexArr, std::vector<RegexPattern>& patterns)
             {
@@ -208,6 +705,15 @@ EpubTranslator::EpubTranslator(const fs::path& projectDir, std::shared_ptr<ICont
         readRegexArr(preRegexArr, m_preRegexPatterns);
         auto postRegexArr = parseToml<toml::array>(projectConfig, pluginConfig, "plugins.Epub.后处理正则");
         readRegexArr(postRegexArr, m_postRegexPatterns);
+        m_preRegexCostNs = std::vector<std::atomic<int64_t>>(m_preRegexPatterns.size());
+        m_postRegexCostNs = std::vector<std::atomic<int64_t>>(m_postRegexPatterns.size());
+
+        std::stringstream ss;
+        ss << preRegexArr;
+        m_epubExtractHash = fnv1a64(ss.str());
+        ss.str("");
+        ss << postRegexArr;
+        m_epubRebuildHash = fnv1a64(std::format("{}\x1f{}\x1f{}\x1f{}", ss.str(), m_bilingualOutput, m_originalTextColor, m_originalTextScale));
     }
     catch (const toml::parse_error& e) {
         m_logger->critical("项目配置文件解析失败, 错误位置: {}, 错误信息: {}", stream2String(e.source().begin), e.description());
@@ -227,7 +733,7 @@ void EpubTranslator::run()
         }
     }
 
-    for (const auto& dir : { m_tempUnpackDir, m_tempRebuildDir, m_inputDir, m_outputDir }) {
+    for (const auto& dir : { m_inputDir, m_outputDir, m_htmlSpillDir }) {
         fs::remove_all(dir);
         fs::create_directories(dir);
     }
@@ -242,274 +748,840 @@ void EpubTranslator::run()
         throw std::runtime_error("未找到 EPUB 文件");
     }
 
-    // 正则替换
-    auto regexReplace = [this](const std::vector<RegexPattern>& regexPatterns, std::string& content)
+    m_cpuPool = std::make_unique<ctpl::thread_pool>(std::max(1, (int)std::thread::hardware_concurrency()));
+
+    m_onFileProcessed = [this](fs::path relProcessedFile)
         {
-            icu::UnicodeString contentUStr = icu::UnicodeString::fromUTF8(content);
-            for (const auto& reg : regexPatterns) {
-                UErrorCode status = U_ZERO_ERROR;
-                std::unique_ptr<icu::RegexMatcher> matcher(reg.org->matcher(contentUStr, status));
-                if (U_FAILURE(status)) {
-                    m_logger->error("预处理正则匹配失败");
-                    continue;
+            auto book = std::make_shared<BookRebuild>();
+            auto chapters = std::make_shared<std::vector<ExtractedChapter>>();
+            {
+                // 生产者可能仍在登记后面的书，簿记和完成判断在锁内进行，重组在锁外进行
+                std::lock_guard<std::mutex> lock(m_epubMapsMutex);
+                if (!m_jsonToEpubPathMap.count(relProcessedFile) || !m_epubToJsonsMap.count(m_jsonToEpubPathMap[relProcessedFile])) {
+                    m_logger->warn("未找到与 {} 对应的元数据，跳过", wide2Ascii(relProcessedFile));
+                    return;
+                }
+                book->epubPath = m_jsonToEpubPathMap[relProcessedFile];
+                book->manifest = m_epubToManifestMap[book->epubPath];
+                if (auto sharedIt = m_epubToSharedJsonMap.find(book->epubPath); sharedIt != m_epubToSharedJsonMap.end()) {
+                    book->sharedJsonPath = sharedIt->second;
                 }
-                if (reg.isCallback) {
-                    icu::UnicodeString newContentUstr;
-                    while (matcher->find() && U_SUCCESS(status)) {
-                        icu::UnicodeString patternUstr;
-                        for (int32_t i = 1; i < matcher->groupCount() + 1; i++) {
-                            icu::UnicodeString groupUstr = matcher->group(i, status);
-                            auto equalRange = reg.callbackPatterns.equal_range(i);
-                            for (auto it = equalRange.first; it != equalRange.second; ++it) {
-                                std::unique_ptr<icu::RegexMatcher> callbackMatcher(it->second.org->matcher(groupUstr, status));
-                                if (U_FAILURE(status)) {
-                                    m_logger->error("预处理正则回调匹配失败");
-                                    continue;
+                std::map<fs::path, bool>& jsonsMap = m_epubToJsonsMap[book->epubPath];
+                jsonsMap[relProcessedFile] = true;
+                if (
+                    std::ranges::any_of(jsonsMap, [](const auto& p)
+                        {
+                            return !p.second;
+                        })
+                    )
+                {
+                    return;
+                }
+                for (const auto& [relJsonPath, isProcessed] : jsonsMap) {
+                    if (!m_jsonToHtmlEntryMap.count(relJsonPath) || !m_jsonToMetadataMap.count(relJsonPath) || !m_jsonToPreprocessedHtmlMap.count(relJsonPath)) continue;
+                    auto preprocessedIt = m_jsonToPreprocessedHtmlMap.find(relJsonPath);
+                    ExtractedChapter& chapter = chapters->emplace_back(m_jsonToHtmlEntryMap[relJsonPath], relJsonPath, m_jsonToNormalPostMap[relJsonPath],
+                        m_jsonToMetadataMap[relJsonPath], std::vector<std::string>{}, std::move(preprocessedIt->second));
+                    chapter.preprocessed = m_rawHtmlJsons.erase(relJsonPath) == 0;
+                    m_jsonToPreprocessedHtmlMap.erase(preprocessedIt);
+                    if (auto spilledIt = m_jsonToSpilledHtmlMap.find(relJsonPath); spilledIt != m_jsonToSpilledHtmlMap.end()) {
+                        chapter.spilledHtmlPath = spilledIt->second;
+                        m_jsonToSpilledHtmlMap.erase(spilledIt);
+                    }
+                }
+                m_epubToManifestMap.erase(book->epubPath);
+            }
+            book->updatePrevious = canUpdatePreviousOutput(*book, m_epubOutputDir / fs::relative(book->epubPath, m_epubInputDir));
+
+            // 这本epub的所有文件都翻译完毕，各章节交给 CPU 线程池重组，当前的翻译线程立即返回
+            std::lock_guard<std::mutex> lock(m_rebuildResultsMutex);
+            if (chapters->empty()) {
+                m_rebuildResults.emplace_back(m_cpuPool->push([this, book](int)
+                    {
+                        packBook(*book);
+                    }));
+                return;
+            }
+            book->remainingChapters = chapters->size();
+            for (size_t i = 0; i < chapters->size(); ++i) {
+                m_rebuildResults.emplace_back(m_cpuPool->push([this, book, chapters, i](int)
+                    {
+                        ExtractedChapter& chapter = (*chapters)[i];
+                        std::vector<Sentence> translatedData;
+                        std::vector<const std::string*> translatedTexts = collectTranslations(chapter, *book, translatedData);
+                        uint64_t outputHash = fnv1a64(chapter.entryName);
+                        for (const std::string* translatedText : translatedTexts) {
+                            outputHash = fnv1a64("\x1f", fnv1a64(*translatedText, outputHash));
+                        }
+                        std::string outputHashStr = std::format("{:016x}", outputHash);
+
+                        // 原文和译文都与上次相同的章节在上次的输出中已经是最终内容，不必重组
+                        // 要保存中间 HTML 而 epub_show_normal_post 中的文件被删掉时仍需重组以便写出
+                        bool unchanged = false;
+                        if (book->updatePrevious && (!m_saveIntermediateHtml || fs::exists(chapter.showNormalPostHtmlPath))) {
+                            std::lock_guard<std::mutex> lock(book->mutex);
+                            const json& previousChapters = book->manifest->previous.at("chapters");
+                            const json& currentChapter = book->manifest->current.at("chapters").at(chapter.entryName);
+                            auto it = previousChapters.find(chapter.entryName);
+                            unchanged = it != previousChapters.end() && it->value("sourceHash", "") == currentChapter.value("sourceHash", "") &&
+                                it->value("outputHash", "") == outputHashStr;
+                        }
+                        // 重组后的章节在这里就压缩好，各章节的压缩分散在线程池中并行，打包时只需复制
+                        ZipHandle compressed(nullptr, &zip_discard);
+                        if (!unchanged) {
+                            if (!chapter.spilledHtmlPath.empty()) {
+                                MappedFile spilledHtml(chapter.spilledHtmlPath);
+                                chapter.content.assign(spilledHtml.data(), spilledHtml.size());
+                            }
+                            if (!chapter.preprocessed) {
+                                regexReplace(m_preRegexPatterns, m_preRegexCostNs, chapter.content);
+                            }
+                            std::string newContent = rebuildChapter(chapter, translatedTexts);
+                            auto compressStartTime = std::chrono::steady_clock::now();
+                            compressed = compressEntry(chapter.entryName, newContent);
+                            book->compressNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - compressStartTime).count();
+                        }
+                        chapter.content = std::string();
+                        if (!chapter.spilledHtmlPath.empty()) {
+                            fs::remove(chapter.spilledHtmlPath);
+                        }
+                        {
+                            std::lock_guard<std::mutex> lock(book->mutex);
+                            book->manifest->current["chapters"][chapter.entryName]["outputHash"] = outputHashStr;
+                            if (!unchanged) {
+                                book->replacedEntries.emplace(chapter.entryName, std::move(compressed));
+                            }
+                        }
+                        if (--book->remainingChapters == 0) {
+                            packBook(*book);
+                        }
+                    }));
+            }
+        };
+
+    // HTML 直接从 zip 中读入内存，章节的正则和解析在 CPU 线程池中并行，
+    // 每本书提取完就按顺序交给翻译线程池，请求 API 的翻译模式下前面的书在翻译时后面的书仍在提取
+    m_inputProducer = [this, &epubFiles](const std::function<void(const std::vector<fs::path>&)>& feed)
+        {
+            struct PendingBook {
+                fs::path epubPath;
+                fs::path relBookDir;
+                std::shared_ptr<BookManifest> manifest;
+                // 上次的提取结果，只在提取期间使用
+                std::shared_ptr<const json> previousNodes;
+                uint64_t structureHash = 0;
+                std::vector<std::future<ExtractedChapter>> chapters;
+            };
+            std::deque<PendingBook> pendingBooks;
+
+            auto registerFrontBook = [&]()
+                {
+                    PendingBook& pendingBook = pendingBooks.front();
+                    std::vector<ExtractedChapter> chapters;
+                    for (auto& chapterResult : pendingBook.chapters) {
+                        chapters.push_back(chapterResult.get());
+                    }
+
+                    pendingBook.previousNodes.reset();
+
+                    // 提取结果在去重之前写进 nodes 文件，下次运行时原始内容不变的章节直接取用
+                    // 没有文本的章节不参与重组，会从底本原样复制，它们的变化要记进结构哈希，迫使整本书从原书重新打包
+                    json& manifestChapters = pendingBook.manifest->current["chapters"];
+                    json bookNodes = {
+                        {"version", epubManifestVersion},
+                        {"extractHash", std::format("{:016x}", m_epubExtractHash)},
+                        {"chapters", json::object()},
+                    };
+                    uint64_t structureHash = pendingBook.structureHash;
+                    for (const auto& chapter : chapters) {
+                        std::string sourceHashStr = std::format("{:016x}", chapter.sourceHash);
+                        if (chapter.metadata.empty()) {
+                            structureHash = fnv1a64(std::format("{}\x1f{}\x1f", chapter.entryName, sourceHashStr), structureHash);
+                        }
+                        json nodes = json::array();
+                        for (size_t i = 0; i < chapter.metadata.size(); ++i) {
+                            nodes.push_back({ chapter.metadata[i].offset, chapter.metadata[i].length, chapter.texts[i] });
+                        }
+                        bookNodes["chapters"][chapter.entryName] = { {"sourceHash", sourceHashStr}, {"nodes", std::move(nodes)} };
+                        manifestChapters[chapter.entryName] = { {"sourceHash", sourceHashStr} };
+                    }
+                    pendingBook.manifest->current["structureHash"] = std::format("{:016x}", structureHash);
+                    fs::path nodesPath = getBookManifestPath(pendingBook.relBookDir, L".nodes.json");
+                    createParent(nodesPath);
+                    std::ofstream nodesOfs(nodesPath);
+                    nodesOfs << bookNodes.dump();
+                    nodesOfs.close();
+                    bookNodes = json();
+                    std::erase_if(chapters, [](const ExtractedChapter& chapter)
+                        {
+                            return chapter.metadata.empty();
+                        });
+
+                    // 去重要看到整本书的章节，所以输入 json 在这里统一写出，写出仍交给线程池并行
+                    std::vector<std::string> sharedTexts;
+                    if (m_dedupMinChapters > 0) {
+                        sharedTexts = dedupBookChapters(chapters);
+                    }
+                    bool spillHtml = false;
+                    {
+                        std::lock_guard<std::mutex> lock(m_epubMapsMutex);
+                        spillHtml = m_inMemoryHtmlEpubs.size() >= (size_t)m_cpuPool->size();
+                    }
+                    std::vector<std::future<void>> writeResults;
+                    for (auto& chapter : chapters) {
+                        if (chapter.texts.empty() && !spillHtml) {
+                            continue;
+                        }
+                        writeResults.emplace_back(m_cpuPool->push([this, &chapter, spillHtml](int)
+                            {
+                                if (!chapter.texts.empty()) {
+                                    writeInputJson(chapter.relJsonPath, chapter.texts);
+                                    chapter.texts = std::vector<std::string>();
                                 }
-                                groupUstr = callbackMatcher->replaceAll(it->second.rep, status);
-                                if (U_FAILURE(status)) {
-                                    m_logger->error("预处理正则回调替换失败");
-                                    continue;
+                                if (spillHtml) {
+                                    // 以章节路径和内容的哈希命名，不同的书和章节不会写到同一个文件
+                                    chapter.spilledHtmlPath = m_htmlSpillDir /
+                                        std::format("{:016x}.html", fnv1a64(chapter.content, fnv1a64(wide2Ascii(chapter.relJsonPath))));
+                                    createParent(chapter.spilledHtmlPath);
+                                    std::ofstream ofs(chapter.spilledHtmlPath, std::ios::binary);
+                                    ofs << chapter.content;
+                                    ofs.close();
+                                    chapter.content = std::string();
                                 }
+                            }));
+                    }
+                    fs::path sharedJsonPath = pendingBook.relBookDir / L"__epub_shared__.json";
+                    if (!sharedTexts.empty()) {
+                        writeInputJson(sharedJsonPath, sharedTexts);
+                    }
+                    // 任务引用着 chapters，先全部等完再取结果，出错时也不会留下仍在运行的任务
+                    for (auto& writeResult : writeResults) {
+                        writeResult.wait();
+                    }
+                    for (auto& writeResult : writeResults) {
+                        writeResult.get();
+                    }
+
+                    // 一本书的章节全部登记后才交出去，保证这本书的完成判断不会提前
+                    // 所有文本都被去重的章节没有自己的 json，登记时直接视为已完成
+                    std::vector<fs::path> bookJsonPaths;
+                    {
+                        std::lock_guard<std::mutex> lock(m_epubMapsMutex);
+                        for (auto& chapter : chapters) {
+                            const fs::path& relJsonPath = chapter.relJsonPath;
+                            bool hasOwnJson = std::ranges::any_of(chapter.metadata, [](const EpubTextNodeInfo& info)
+                                {
+                                    return info.sharedIndex < 0;
+                                });
+                            m_jsonToHtmlEntryMap[relJsonPath] = chapter.entryName;
+                            m_jsonToEpubPathMap[relJsonPath] = pendingBook.epubPath;
+                            m_jsonToNormalPostMap[relJsonPath] = chapter.showNormalPostHtmlPath;
+                            m_epubToJsonsMap[pendingBook.epubPath].insert(std::make_pair(relJsonPath, !hasOwnJson));
+                            m_jsonToMetadataMap[relJsonPath] = std::move(chapter.metadata);
+                            m_jsonToPreprocessedHtmlMap[relJsonPath] = std::move(chapter.content);
+                            if (!chapter.preprocessed) {
+                                m_rawHtmlJsons.insert(relJsonPath);
+                            }
+                            if (!chapter.spilledHtmlPath.empty()) {
+                                m_jsonToSpilledHtmlMap[relJsonPath] = chapter.spilledHtmlPath;
                             }
-                            patternUstr.append(groupUstr);
+                            if (hasOwnJson) {
+                                bookJsonPaths.push_back(relJsonPath);
+                            }
+                        }
+                        if (!sharedTexts.empty()) {
+                            m_jsonToEpubPathMap[sharedJsonPath] = pendingBook.epubPath;
+                            m_epubToJsonsMap[pendingBook.epubPath].insert(std::make_pair(sharedJsonPath, false));
+                            m_epubToSharedJsonMap[pendingBook.epubPath] = sharedJsonPath;
+                            bookJsonPaths.push_back(sharedJsonPath);
+                        }
+                        m_epubToManifestMap[pendingBook.epubPath] = pendingBook.manifest;
+                        if (!spillHtml && !chapters.empty()) {
+                            m_inMemoryHtmlEpubs.insert(pendingBook.epubPath);
                         }
-                        matcher->appendReplacement(newContentUstr, patternUstr, status);
                     }
-                    matcher->appendTail(newContentUstr);
-                    contentUStr = newContentUstr;
+                    pendingBooks.pop_front();
+                    if (!bookJsonPaths.empty()) {
+                        feed(bookJsonPaths);
+                    }
+                };
+
+            for (const auto& epubPath : epubFiles) {
+                fs::path relEpubPath = fs::relative(epubPath, m_epubInputDir); // dir1/book1.epub
+                fs::path relBookDir = relEpubPath.parent_path() / relEpubPath.stem(); // dir1/book1
+
+                m_logger->debug("读取 {}", wide2Ascii(epubPath));
+                PendingBook& pendingBook = pendingBooks.emplace_back();
+                pendingBook.epubPath = epubPath;
+                pendingBook.relBookDir = relBookDir;
+                pendingBook.manifest = std::make_shared<BookManifest>();
+                pendingBook.manifest->previous = loadManifestFile(getBookManifestPath(relBookDir));
+                // 预处理正则没有变化时，上次的提取结果可以按章节复用
+                pendingBook.previousNodes = std::make_shared<const json>(loadManifestFile(getBookManifestPath(relBookDir, L".nodes.json")));
+                const json& previousNodes = *pendingBook.previousNodes;
+                const json* previousChapters = nullptr;
+                if (previousNodes.is_object() && previousNodes.value("version", 0) == epubManifestVersion &&
+                    previousNodes.value("extractHash", "") == std::format("{:016x}", m_epubExtractHash) && previousNodes.contains("chapters"))
+                {
+                    previousChapters = &previousNodes["chapters"];
                 }
-                else {
-                    contentUStr = matcher->replaceAll(reg.rep, status);
-                    if (U_FAILURE(status)) {
-                        m_logger->error("预处理正则替换失败");
+
+                // zip_t 不能跨线程共享，条目在本线程读出后再交给线程池
+                ZipHandle za = openZipForRead(epubPath);
+                zip_int64_t numEntries = zip_get_num_entries(za.get(), 0);
+                // 章节以外的条目的名字、CRC 和大小，以及所有章节的名字，用来判断原书除章节内容以外的部分有没有变化
+                // 章节内容的变化由各章节的 sourceHash 判断，只需替换变化的章节
+                uint64_t structureHash = fnv1a64(wide2Ascii(relEpubPath));
+                for (zip_int64_t idx = 0; idx < numEntries; ++idx) {
+                    zip_stat_t st;
+                    zip_stat_init(&st);
+                    if (zip_stat_index(za.get(), idx, 0, &st) < 0) {
+                        throw std::runtime_error(std::format("无法读取 {} 中的条目信息: {}", wide2Ascii(epubPath), zip_strerror(za.get())));
+                    }
+                    const char* name = zip_get_name(za.get(), idx, ZIP_FL_ENC_GUESS);
+                    if (!name || !isHtmlEntry(name)) {
+                        structureHash = fnv1a64(std::format("{}\x1f{:08x}\x1f{}\x1f", st.name, st.crc, st.size), structureHash);
+                        continue;
                     }
+                    structureHash = fnv1a64(std::format("{}\x1f", st.name), structureHash);
+                    std::string entryName = name;
+                    std::string content = readZipEntry(za.get(), idx);
+                    pendingBook.chapters.emplace_back(m_cpuPool->push(
+                        // previousChapters 指向 previousNodes 内部，一并持有 previousNodes 保证它在任务结束前有效
+                        [this, relBookDir, previousNodes = pendingBook.previousNodes, previousChapters, entryName = std::move(entryName), content = std::move(content)](int) mutable
+                        {
+                            return extractChapter(relBookDir, std::move(entryName), std::move(content), previousChapters);
+                        }));
                 }
+                za.reset();
+                pendingBook.manifest->current = {
+                    {"version", epubManifestVersion},
+                    {"extractHash", std::format("{:016x}", m_epubExtractHash)},
+                    {"rebuildHash", std::format("{:016x}", m_epubRebuildHash)},
+                    {"chapters", json::object()},
+                };
+                pendingBook.structureHash = structureHash;
+
+                // 已经提取完的书立即交出去，排队的书太多时等最前面的一本，避免把整个书库都读进内存
+                while (!pendingBooks.empty() && (pendingBooks.size() > (size_t)m_cpuPool->size() ||
+                    std::ranges::all_of(pendingBooks.front().chapters, [](const auto& chapterResult)
+                        {
+                            return chapterResult.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+                        })))
+                {
+                    registerFrontBook();
+                }
+            }
+            while (!pendingBooks.empty()) {
+                registerFrontBook();
             }
-            content.clear();
-            contentUStr.toUTF8String(content);
         };
 
+    NormalJsonTranslator::run();
+
+    // 等待仍在 CPU 线程池中的重组和打包
+    std::vector<std::future<void>> rebuildResults;
+    {
+        std::lock_guard<std::mutex> lock(m_rebuildResultsMutex);
+        rebuildResults.swap(m_rebuildResults);
+    }
+    for (auto& result : rebuildResults) {
+        result.get();
+    }
+
+    if (m_dedupMinChapters > 0) {
+        m_logger->info("跨章节去重: 省去 {} 个重复文本节点的翻译，约 {} 个原文 token", m_dedupSavedNodes.load(), m_dedupSavedTokens.load());
+    }
+    if (m_compareWithGumbo) {
+        m_logger->info("Gumbo 对照: 共对照 {} 个章节，其中 {} 个章节的提取结果与 Gumbo 不一致", m_gumboComparedChapters.load(), m_gumboMismatchedChapters.load());
+    }
 
-    for (const auto& epubPath : epubFiles) {
-        fs::path relEpubPath = fs::relative(epubPath, m_epubInputDir); // dir1/book1.epub
-        fs::path bookUnpackPath = m_tempUnpackDir / relEpubPath.parent_path() / relEpubPath.stem(); // cache/myproject/epub_unpacked/dir1/book1
-        fs::path bookRebuildPath = m_tempRebuildDir / relEpubPath.parent_path() / relEpubPath.stem(); // cache/myproject/epub_rebuild/dir1/book1
+    if (m_logger->should_log(spdlog::level::debug)) {
+        logRegexCost("预处理正则", m_preRegexPatterns, m_preRegexCostNs);
+        logRegexCost("后处理正则", m_postRegexPatterns, m_postRegexCostNs);
+    }
+}
 
-        // 解压 EPUB 文件
-        m_logger->debug("解压 {} 到 {}", wide2Ascii(epubPath), wide2Ascii(bookUnpackPath));
-        fs::create_directories(bookUnpackPath);
-        if (!extractZip(epubPath, bookUnpackPath)) {
-            throw std::runtime_error(std::format("解压 {} 失败，无法打开文件", wide2Ascii(epubPath)));
+EpubTranslator::ExtractedChapter EpubTranslator::extractChapter(const fs::path& relBookDir, std::string entryName, std::string content, const json* previousChapters)
+{
+    // 创建json相对路径
+    fs::path relativePath = ascii2Wide(entryName); // OEBPS/chapter1.html
+    fs::path showNormalHtmlPath = m_projectDir / L"epub_show_normal" / relBookDir / relativePath;
+    ExtractedChapter chapter;
+    chapter.showNormalPostHtmlPath = m_projectDir / L"epub_show_normal_post" / relBookDir / relativePath;
+    chapter.relJsonPath = relBookDir / relativePath.replace_extension(".json"); // dir1/book1/OEBPS/chapter1.json
+    chapter.sourceHash = fnv1a64(content);
+
+    // 原始内容与上次相同，预处理正则也没变，提取结果必然相同，content 留待需要重组时再做预处理
+    // ShowNormal 模式要重新生成 show_normal 文件，文件被删掉时也要重新提取以便写出，对照 Gumbo 时也总是重新提取
+    if (previousChapters && m_transEngine != TransEngine::ShowNormal && !m_compareWithGumbo) {
+        auto it = previousChapters->find(entryName);
+        if (it != previousChapters->end() && it->value("sourceHash", "") == std::format("{:016x}", chapter.sourceHash) && it->contains("nodes") &&
+            (!m_saveIntermediateHtml || (*it)["nodes"].empty() || fs::exists(showNormalHtmlPath)))
+        {
+            for (const auto& node : (*it)["nodes"]) {
+                chapter.metadata.push_back(EpubTextNodeInfo{ node[0].get<size_t>(), node[1].get<size_t>() });
+                chapter.texts.push_back(node[2].get<std::string>());
+            }
+            chapter.preprocessed = false;
+            chapter.entryName = std::move(entryName);
+            chapter.content = std::move(content);
+            return chapter;
         }
+    }
 
-        // 从html中提取json和元数据
-        createParent(bookRebuildPath);
-        fs::copy(bookUnpackPath, bookRebuildPath, fs::copy_options::recursive);
-        fs::path relBookDir = relEpubPath.parent_path() / relEpubPath.stem(); // dir1/book1
-        for (const auto& htmlEntry : fs::recursive_directory_iterator(bookUnpackPath)) {
-            if (htmlEntry.is_regular_file() && (isSameExtension(htmlEntry.path(), L".html") || isSameExtension(htmlEntry.path(), L".xhtml"))) {
+    regexReplace(m_preRegexPatterns, m_preRegexCostNs, content);
 
-                std::ifstream ifs(htmlEntry.path(), std::ios::binary);
-                std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    std::vector<std::pair<std::string, EpubTextNodeInfo>> sentences;
+    extractTextNodes(content, sentences);
 
-                regexReplace(m_preRegexPatterns, content);
+    if (m_compareWithGumbo) {
+        GumboOutput* output = gumbo_parse_with_options(&kGumboDefaultOptions, content.data(), content.size());
+        std::vector<std::pair<std::string, EpubTextNodeInfo>> gumboSentences;
+        extractTextNodes(output->root, gumboSentences);
+        gumbo_destroy_output(&kGumboDefaultOptions, output);
+        std::ranges::sort(gumboSentences, [](const auto& a, const auto& b)
+            {
+                return a.second.offset < b.second.offset;
+            });
 
-                GumboOutput* output = gumbo_parse(content.c_str());
-                std::vector<std::pair<std::string, EpubTextNodeInfo>> sentences;
-                extractTextNodes(output->root, sentences);
-                gumbo_destroy_output(&kGumboDefaultOptions, output);
+        ++m_gumboComparedChapters;
+        auto [streamIt, gumboIt] = std::ranges::mismatch(sentences, gumboSentences, [](const auto& a, const auto& b)
+            {
+                return a.first == b.first && a.second.offset == b.second.offset && a.second.length == b.second.length;
+            });
+        if (streamIt != sentences.end() || gumboIt != gumboSentences.end()) {
+            ++m_gumboMismatchedChapters;
+            auto describe = [](const auto& it, const auto& end) -> std::string
+                {
+                    return it == end ? "(无)" : std::format("offset {} length {} 文本 [{}]", it->second.offset, it->second.length, it->first);
+                };
+            m_logger->warn("{} 中的 {} 流式提取与 Gumbo 结果不一致(第 {} 个文本节点), 流式: {}, Gumbo: {}, 本章改用 Gumbo 的结果",
+                wide2Ascii(relBookDir), entryName, streamIt - sentences.begin() + 1,
+                describe(streamIt, sentences.end()), describe(gumboIt, gumboSentences.end()));
+            sentences = std::move(gumboSentences);
+        }
+    }
 
-                if (sentences.empty()) continue;
+    if (sentences.empty()) {
+        chapter.entryName = std::move(entryName);
+        return chapter;
+    }
 
-                // 创建json相对路径
-                fs::path relativePath = fs::relative(htmlEntry.path(), bookUnpackPath); // OEBPS/chapter1.html
-                fs::path showNormalHtmlPath = m_projectDir / L"epub_show_normal" / relBookDir / relativePath;
-                fs::path showNormalPostHtmlPath = m_projectDir / L"epub_show_normal_post" / relBookDir / relativePath;
-                fs::path relJsonPath = relBookDir / relativePath.replace_extension(".json"); // dir1/book1/OEBPS/chapter1.json
+    // 文本节点按文档顺序产生，已经按偏移有序
+    for (auto& [text, info] : sentences) {
+        chapter.texts.push_back(std::move(text));
+        chapter.metadata.push_back(info);
+    }
 
+    if (m_saveIntermediateHtml) {
+        createParent(showNormalHtmlPath);
+        std::ofstream ofs(showNormalHtmlPath, std::ios::binary);
+        ofs << content;
+        ofs.close();
+    }
 
-                // 存储映射关系
-                m_jsonToHtmlPathMap[relJsonPath] = htmlEntry.path();
-                m_jsonToEpubPathMap[relJsonPath] = epubPath;
-                m_jsonToNormalPostMap[relJsonPath] = showNormalPostHtmlPath;
-                m_epubToJsonsMap[epubPath].insert(std::make_pair(relJsonPath, false));
+    chapter.entryName = std::move(entryName);
+    chapter.content = std::move(content);
+    return chapter;
+}
 
-                // 存储元数据
-                std::ranges::sort(sentences, [](const auto& a, const auto& b)
-                    {
-                        return a.second.offset < b.second.offset;
-                    });
-                std::vector<EpubTextNodeInfo> metadata;
-                json j = json::array();
-                for (const auto& p : sentences) {
-                    // TODO: 添加可选正则区分 name 和 message
-                    j.push_back({ {"name", ""}, {"message", p.first} });
-                    metadata.push_back(p.second);
-                }
-                m_jsonToMetadataMap[relJsonPath] = metadata;
-
-                createParent(m_inputDir / relJsonPath); // cache/myproject/epub_json_input/dir1/book1/OEBPS/chapter1.json
-                std::ofstream ofs;
-                ofs.open(m_inputDir / relJsonPath);
-                ofs << j.dump(2);
-                ofs.close();
-
-                createParent(showNormalHtmlPath);
-                ofs.open(showNormalHtmlPath, std::ios::binary);
-                ofs << content;
-                ofs.close();
+std::vector<std::string> EpubTranslator::dedupBookChapters(std::vector<ExtractedChapter>& chapters)
+{
+    // 每个文本出现在多少个不同的章节中
+    std::unordered_map<std::string_view, int> chapterCounts;
+    for (const auto& chapter : chapters) {
+        std::unordered_set<std::string_view> seen;
+        for (const auto& text : chapter.texts) {
+            if (seen.insert(text).second) {
+                chapterCounts[text]++;
             }
         }
     }
 
-    m_onFileProcessed = [this, &regexReplace](fs::path relProcessedFile)
-        {
-            if (!m_jsonToEpubPathMap.count(relProcessedFile) || !m_epubToJsonsMap.count(m_jsonToEpubPathMap[relProcessedFile])) {
-                m_logger->warn("未找到与 {} 对应的元数据，跳过", wide2Ascii(relProcessedFile));
-                return;
+    std::vector<std::string> sharedTexts;
+    std::unordered_map<std::string_view, int> sharedIndices;
+    size_t savedNodes = 0;
+    size_t savedTokens = 0;
+    for (auto& chapter : chapters) {
+        for (size_t i = 0; i < chapter.texts.size(); ++i) {
+            const std::string& text = chapter.texts[i];
+            if (chapterCounts[text] < m_dedupMinChapters) {
+                continue;
             }
-            fs::path epubPath = m_jsonToEpubPathMap[relProcessedFile];
-            std::map<fs::path, bool>& jsonsMap = m_epubToJsonsMap[epubPath];
-            jsonsMap[relProcessedFile] = true;
-            if (
-                std::ranges::any_of(jsonsMap, [](const auto& p)
-                    {
-                        return !p.second;
-                    })
-                ) 
-            {
-                return;
+            auto [it, inserted] = sharedIndices.try_emplace(text, (int)sharedTexts.size());
+            if (inserted) {
+                sharedTexts.push_back(text);
             }
+            else {
+                savedNodes++;
+                savedTokens += estimateTokens(text);
+            }
+            chapter.metadata[i].sharedIndex = it->second;
+        }
+    }
 
-            // 这本epub的所有文件都翻译完毕，可以开始重组
-            for (const auto& [relJsonPath, isProcessed] : jsonsMap) {
-                if (!m_jsonToHtmlPathMap.count(relJsonPath) || !m_jsonToMetadataMap.count(relJsonPath)) continue;
-
-                fs::path originalHtmlPath = m_jsonToHtmlPathMap[relJsonPath];
-                fs::path rebuiltHtmlPath = m_tempRebuildDir / fs::relative(originalHtmlPath, m_tempUnpackDir);
-                const auto& metadata = m_jsonToMetadataMap[relJsonPath];
+    // 上面两个表的键引用着章节中的文本，全部判断完之后再把共用的文本从章节中移除
+    for (auto& chapter : chapters) {
+        std::vector<std::string> ownTexts;
+        for (size_t i = 0; i < chapter.texts.size(); ++i) {
+            if (chapter.metadata[i].sharedIndex < 0) {
+                ownTexts.push_back(std::move(chapter.texts[i]));
+            }
+        }
+        chapter.texts = std::move(ownTexts);
+    }
 
-                // 替换 HTML 内容的逻辑
-                std::ifstream ifs(rebuiltHtmlPath, std::ios::binary);
-                std::string originalContent((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-                ifs.close();
+    m_dedupSavedNodes += savedNodes;
+    m_dedupSavedTokens += savedTokens;
+    return sharedTexts;
+}
 
-                // 预处理正则替换
-                regexReplace(m_preRegexPatterns, originalContent);
+void EpubTranslator::writeInputJson(const fs::path& relJsonPath, const std::vector<std::string>& texts)
+{
+    json j = json::array();
+    for (const auto& text : texts) {
+        // TODO: 添加可选正则区分 name 和 message
+        j.push_back({ {"name", ""}, {"message", text} });
+    }
+    createParent(m_inputDir / relJsonPath); // cache/myproject/epub_json_input/dir1/book1/OEBPS/chapter1.json
+    std::ofstream ofs(m_inputDir / relJsonPath);
+    ofs << j.dump(2);
+    ofs.close();
+}
 
-                ifs.open(m_outputDir / relJsonPath);
-                json translatedData = json::parse(ifs);
-                ifs.close();
+std::vector<const std::string*> EpubTranslator::collectTranslations(const ExtractedChapter& chapter, BookRebuild& book, std::vector<Sentence>& translatedData)
+{
+    const auto& metadata = chapter.metadata;
 
-                if (metadata.size() != translatedData.size()) {
-                    throw std::runtime_error(std::format("元数据和翻译数据数量不匹配，无法重组: {}", wide2Ascii(rebuiltHtmlPath)));
-                }
+    size_t ownCount = std::ranges::count_if(metadata, [](const EpubTextNodeInfo& info)
+        {
+            return info.sharedIndex < 0;
+        });
+    if (ownCount > 0) {
+        translatedData = readOutputJson(m_outputDir / chapter.relJsonPath);
+    }
+    if (ownCount != translatedData.size()) {
+        throw std::runtime_error(std::format("元数据和翻译数据数量不匹配，无法重组: {}", wide2Ascii(chapter.relJsonPath)));
+    }
+    if (ownCount < metadata.size()) {
+        std::call_once(book.sharedOnce, [&]()
+            {
+                book.sharedTranslations = readOutputJson(m_outputDir / book.sharedJsonPath);
+            });
+    }
 
-                std::string newContent;
-                newContent.reserve(originalContent.length() * 2);
-                size_t lastPos = 0;
-
-                for (size_t i = 0; i < metadata.size(); ++i) {
-                    std::string translatedText = translatedData[i].value("message", "");
-                    std::string replacement = m_bilingualOutput ?
-                        (translatedText + "<br/><span style=\"color:" + m_originalTextColor + "; font-size:" + m_originalTextScale +
-                            "em;\">" + originalContent.substr(metadata[i].offset, metadata[i].length) + "</span>")
-                        : translatedText;
-                    newContent.append(originalContent.substr(lastPos, metadata[i].offset - lastPos));
-                    newContent.append(replacement);
-                    lastPos = metadata[i].offset + metadata[i].length;
-                }
-                if (lastPos < originalContent.length()) {
-                    newContent.append(originalContent.substr(lastPos));
-                }
+    std::vector<const std::string*> translatedTexts;
+    translatedTexts.reserve(metadata.size());
+    for (size_t i = 0, own = 0; i < metadata.size(); ++i) {
+        if (metadata[i].sharedIndex < 0) {
+            translatedTexts.push_back(&translatedData[own++].translated_preview);
+            continue;
+        }
+        if ((size_t)metadata[i].sharedIndex >= book.sharedTranslations.size()) {
+            throw std::runtime_error(std::format("共用译文数量不足，无法重组: {}", wide2Ascii(chapter.relJsonPath)));
+        }
+        translatedTexts.push_back(&book.sharedTranslations[metadata[i].sharedIndex].translated_preview);
+    }
+    return translatedTexts;
+}
 
-                // 后处理正则替换
-                regexReplace(m_postRegexPatterns, newContent);
+std::string EpubTranslator::rebuildChapter(const ExtractedChapter& chapter, const std::vector<const std::string*>& translatedTexts)
+{
+    // chapter.content 已经是预处理正则替换后的内容
+    const std::string& originalContent = chapter.content;
+    const auto& metadata = chapter.metadata;
+
+    // 原文的各段都以 string_view 切片直接追加到预先算好大小的缓冲区，不产生临时字符串
+    std::string_view original(originalContent);
+    const std::string bilingualPrefix = "<br/><span style=\"color:" + m_originalTextColor + "; font-size:" + m_originalTextScale + "em;\">";
+    constexpr std::string_view bilingualSuffix = "</span>";
+    size_t newLength = original.length();
+    for (size_t i = 0; i < metadata.size(); ++i) {
+        newLength += translatedTexts[i]->length() - metadata[i].length;
+        if (m_bilingualOutput) {
+            newLength += bilingualPrefix.length() + metadata[i].length + bilingualSuffix.length();
+        }
+    }
 
-                std::ofstream ofs;
-                ofs.open(rebuiltHtmlPath, std::ios::binary);
-                ofs << newContent;
-                ofs.close();
+    std::string newContent;
+    newContent.reserve(newLength);
+    size_t lastPos = 0;
+
+    for (size_t i = 0; i < metadata.size(); ++i) {
+        newContent.append(original.substr(lastPos, metadata[i].offset - lastPos));
+        newContent.append(*translatedTexts[i]);
+        if (m_bilingualOutput) {
+            newContent.append(bilingualPrefix);
+            newContent.append(original.substr(metadata[i].offset, metadata[i].length));
+            newContent.append(bilingualSuffix);
+        }
+        lastPos = metadata[i].offset + metadata[i].length;
+    }
+    if (lastPos < original.length()) {
+        newContent.append(original.substr(lastPos));
+    }
 
-                fs::path showNormalPostHtmlPath = m_jsonToNormalPostMap[relJsonPath];
-                createParent(showNormalPostHtmlPath);
-                ofs.open(showNormalPostHtmlPath, std::ios::binary);
-                ofs << newContent;
-                ofs.close();
-            }
+    // 后处理正则替换
+    regexReplace(m_postRegexPatterns, m_postRegexCostNs, newContent);
 
-            fs::path relEpubPath = fs::relative(epubPath, m_epubInputDir);
-            fs::path bookRebuildPath = m_tempRebuildDir / relEpubPath.parent_path() / relEpubPath.stem();
+    if (m_saveIntermediateHtml) {
+        createParent(chapter.showNormalPostHtmlPath);
+        std::ofstream ofs(chapter.showNormalPostHtmlPath, std::ios::binary);
+        ofs << newContent;
+        ofs.close();
+    }
+    return newContent;
+}
 
-            fs::path outputEpubPath = m_epubOutputDir / relEpubPath;
-            createParent(outputEpubPath);
-            m_logger->debug("正在打包 {}", wide2Ascii(outputEpubPath));
+fs::path EpubTranslator::getBookManifestPath(const fs::path& relBookDir, const std::wstring& suffix)
+{
+    fs::path manifestPath = m_projectDir / L"epub_manifest" / relBookDir; // myproject/epub_manifest/dir1/book1.json
+    manifestPath += suffix;
+    return manifestPath;
+}
 
-            int error = 0;
-            zip* za = zip_open(wide2Ascii(outputEpubPath).c_str(), ZIP_CREATE | ZIP_TRUNCATE, &error);
-            if (!za) {
-                throw std::runtime_error("无法创建 EPUB (zip) 文件: " + std::to_string(error));
-            }
+json EpubTranslator::loadManifestFile(const fs::path& manifestPath)
+{
+    if (!fs::exists(manifestPath)) {
+        return json();
+    }
+    std::ifstream ifs(manifestPath);
+    try {
+        return json::parse(ifs);
+    }
+    catch (const json::exception& e) {
+        m_logger->warn("解析 {} 时出错，将重新提取和打包这本书: {}", wide2Ascii(manifestPath), e.what());
+        return json();
+    }
+}
 
-            // --- 步骤一：优先处理 mimetype 文件，且不压缩 ---
-            fs::path mimetypePath = bookRebuildPath / "mimetype";
-            if (fs::exists(mimetypePath)) {
-                zip_source_t* s = zip_source_file(za, wide2Ascii(mimetypePath).c_str(), 0, 0);
-                if (!s) {
-                    zip_close(za);
-                    throw std::runtime_error("无法为 mimetype 创建 zip_source_file");
-                }
+bool EpubTranslator::canUpdatePreviousOutput(const BookRebuild& book, const fs::path& outputEpubPath)
+{
+    const json& previous = book.manifest->previous;
+    const json& current = book.manifest->current;
+    if (!previous.is_object() || !previous.contains("chapters") || previous.value("version", 0) != epubManifestVersion) {
+        return false;
+    }
+    for (const char* key : { "extractHash", "rebuildHash", "structureHash" }) {
+        if (previous.value(key, "") != current.value(key, "")) {
+            return false;
+        }
+    }
+    // 输出文件被改动过或者被删掉时也需要完整打包
+    std::error_code ec;
+    uint64_t outputSize = fs::file_size(outputEpubPath, ec);
+    if (ec) {
+        return false;
+    }
+    int64_t outputTime = fs::last_write_time(outputEpubPath, ec).time_since_epoch().count();
+    return !ec && previous.value("outputSize", (uint64_t)0) == outputSize && previous.value("outputTime", (int64_t)0) == outputTime;
+}
 
-                zip_int64_t idx = zip_file_add(za, "mimetype", s, ZIP_FL_ENC_UTF_8);
-                if (idx < 0) {
-                    zip_source_free(s);
-                    zip_close(za);
-                    throw std::runtime_error("无法将 mimetype 添加到 zip");
-                }
+void EpubTranslator::packBook(BookRebuild& book)
+{
+    {
+        // 走到这里时各章节都已重组完毕，它们的 HTML 已经释放
+        std::lock_guard<std::mutex> lock(m_epubMapsMutex);
+        m_inMemoryHtmlEpubs.erase(book.epubPath);
+    }
+    fs::path relEpubPath = fs::relative(book.epubPath, m_epubInputDir);
+    fs::path outputEpubPath = m_epubOutputDir / relEpubPath;
+    if (book.updatePrevious && book.replacedEntries.empty()) {
+        m_logger->info("EPUB 文件的原文和译文均未变化，跳过打包: {}", wide2Ascii(outputEpubPath));
+        return;
+    }
 
-                if (zip_set_file_compression(za, idx, ZIP_CM_STORE, 0) < 0) {
-                    throw std::runtime_error("无法将 mimetype 设置为不压缩模式。");
-                }
-            }
-            else {
-                m_logger->warn("在源目录 {} 中未找到 mimetype 文件，生成的 EPUB 可能无效。", wide2Ascii(bookRebuildPath));
-            }
+    createParent(outputEpubPath);
+    // 底本是上次的输出时不能边读边写，先写到临时文件再替换，打包失败时也不会留下不完整的文件
+    fs::path tempEpubPath = outputEpubPath;
+    tempEpubPath += L".tmp";
+    m_logger->debug("正在打包 {}", wide2Ascii(outputEpubPath));
+    auto packStartTime = std::chrono::steady_clock::now();
+    packEpub(book.updatePrevious ? outputEpubPath : book.epubPath, tempEpubPath, book.replacedEntries);
+    fs::rename(tempEpubPath, outputEpubPath);
+    // 章节的压缩在各自的任务中并行进行，这里给出的是各章节压缩耗时之和，打包耗时只含复制和写出
+    double packMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - packStartTime).count();
+    double compressMs = book.compressNs.load() / 1e6;
+    if (book.updatePrevious) {
+        m_logger->info("已更新 EPUB 文件: {}，替换了 {} 个变化的章节，压缩 {:.1f} ms，打包 {:.1f} ms", wide2Ascii(outputEpubPath),
+            book.replacedEntries.size(), compressMs, packMs);
+    }
+    else {
+        m_logger->info("已重建 EPUB 文件: {}，压缩 {:.1f} ms，打包 {:.1f} ms", wide2Ascii(outputEpubPath), compressMs, packMs);
+    }
 
-            // --- 步骤二：处理其他所有文件和目录 ---
-            for (const auto& entry : fs::recursive_directory_iterator(bookRebuildPath)) {
-                fs::path relativePath = fs::relative(entry.path(), bookRebuildPath);
-                std::string entryName = wide2Ascii(relativePath);
-                std::replace(entryName.begin(), entryName.end(), '\\', '/');
+    // 清单在输出写出之后才保存，中途失败或停止的书下次运行时仍会重新处理
+    json& manifest = book.manifest->current;
+    manifest["outputSize"] = fs::file_size(outputEpubPath);
+    manifest["outputTime"] = fs::last_write_time(outputEpubPath).time_since_epoch().count();
+    fs::path manifestPath = getBookManifestPath(relEpubPath.parent_path() / relEpubPath.stem());
+    createParent(manifestPath);
+    std::ofstream ofs(manifestPath);
+    ofs << manifest.dump();
+    ofs.close();
+}
 
-                if (entryName == "mimetype") {
-                    continue;
-                }
+void EpubTranslator::regexReplace(const std::vector<RegexPattern>& regexPatterns, std::vector<std::atomic<int64_t>>& costNs, std::string& content)
+{
+    if (regexPatterns.empty()) {
+        return;
+    }
+    bool measureCost = m_logger->should_log(spdlog::level::debug);
+
+    // 两块缓冲区轮流作为输入和输出，每一遍只追加到输出缓冲区，不为每条正则新建字符串
+    icu::UnicodeString contentUStr = icu::UnicodeString::fromUTF8(content);
+    icu::UnicodeString outputUStr;
+    icu::UnicodeString replacementUStr;
+    icu::UnicodeString groupUStr;
+    icu::UnicodeString groupOutputUStr;
+    bool changed = false;
+
+    for (size_t p = 0; p < regexPatterns.size(); ++p) {
+        const RegexPattern& reg = regexPatterns[p];
+        auto startTime = std::chrono::steady_clock::now();
+
+        UErrorCode status = U_ZERO_ERROR;
+        std::unique_ptr<icu::RegexMatcher> matcher(reg.org->matcher(contentUStr, status));
+        // 回调正则的 matcher 在这一遍内只建一次，每次匹配到分组时用 reset 复用
+        std::vector<std::unique_ptr<icu::RegexMatcher>> callbackMatchers;
+        for (const auto& [group, callbackPattern] : reg.callbackPatterns) {
+            callbackMatchers.emplace_back(callbackPattern.org->matcher(status));
+        }
+        if (U_FAILURE(status)) {
+            m_logger->error("正则匹配失败");
+            continue;
+        }
 
-                if (fs::is_directory(entry.path())) {
-                    zip_dir_add(za, entryName.c_str(), ZIP_FL_ENC_UTF_8);
-                }
-                else {
-                    zip_source_t* s = zip_source_file(za, wide2Ascii(entry.path()).c_str(), 0, 0);
-                    if (!s) {
-                        throw std::runtime_error(std::format("无法为文件 {} 创建 zip_source_file", entryName));
+        outputUStr.remove();
+        bool found = false;
+        while (matcher->find(status) && U_SUCCESS(status)) {
+            found = true;
+            if (!reg.isCallback) {
+                matcher->appendReplacement(outputUStr, reg.rep, status);
+                continue;
+            }
+            replacementUStr.remove();
+            for (int32_t i = 1; i < matcher->groupCount() + 1; i++) {
+                groupUStr = matcher->group(i, status);
+                size_t c = 0;
+                for (const auto& [group, callbackPattern] : reg.callbackPatterns) {
+                    icu::RegexMatcher& callbackMatcher = *callbackMatchers[c++];
+                    if (group != i) {
+                        continue;
                     }
-                    if (zip_file_add(za, entryName.c_str(), s, ZIP_FL_ENC_UTF_8) < 0) {
-                        zip_source_free(s);
-                        throw std::runtime_error(std::format("无法将文件 {} 添加到 zip", entryName));
+                    callbackMatcher.reset(groupUStr);
+                    groupOutputUStr.remove();
+                    while (callbackMatcher.find(status) && U_SUCCESS(status)) {
+                        callbackMatcher.appendReplacement(groupOutputUStr, callbackPattern.rep, status);
                     }
+                    if (U_FAILURE(status)) {
+                        m_logger->error("正则回调替换失败");
+                        status = U_ZERO_ERROR;
+                        continue;
+                    }
+                    callbackMatcher.appendTail(groupOutputUStr);
+                    groupUStr.swap(groupOutputUStr);
                 }
+                replacementUStr.append(groupUStr);
             }
+            matcher->appendReplacement(outputUStr, replacementUStr, status);
+        }
 
-            // 所有 source 都在 zip_close 中被 libzip 自动管理和释放
-            if (zip_close(za) < 0) {
-                throw std::runtime_error("关闭 zip 存档时出错: " + std::string(zip_strerror(za)));
-            }
-            else {
-                m_logger->info("已重建 EPUB 文件: {}", wide2Ascii(outputEpubPath));
-            }
-        };
+        // 没有匹配的一遍不产生新内容，直接沿用输入
+        if (U_FAILURE(status)) {
+            m_logger->error("正则替换失败");
+        }
+        else if (found) {
+            matcher->appendTail(outputUStr);
+            contentUStr.swap(outputUStr);
+            changed = true;
+        }
 
+        if (measureCost) {
+            costNs[p] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+        }
+    }
 
-    NormalJsonTranslator::run();
+    if (changed) {
+        content.clear();
+        contentUStr.toUTF8String(content);
+    }
+}
+
+void EpubTranslator::logRegexCost(const std::string& kind, const std::vector<RegexPattern>& regexPatterns, const std::vector<std::atomic<int64_t>>& costNs)
+{
+    for (size_t p = 0; p < regexPatterns.size(); ++p) {
+        std::string patternStr;
+        regexPatterns[p].org->pattern().toUTF8String(patternStr);
+        m_logger->debug("{} #{} 累计耗时 {:.1f} ms: {}", kind, p, costNs[p].load() / 1e6, patternStr);
+    }
+}
+
+void EpubTranslator::packEpub(const fs::path& epubPath, const fs::path& outputEpubPath, const std::map<std::string, ZipHandle>& replacedEntries)
+{
+    // src 和 mimetype 要在 za 写出之后才能释放，声明顺序保证异常时也是 za 先被丢弃
+    ZipHandle src = openZipForRead(epubPath);
+    std::string mimetype;
+    int error = 0;
+    ZipHandle za(zip_open(wide2Ascii(outputEpubPath).c_str(), ZIP_CREATE | ZIP_TRUNCATE, &error), &zip_discard);
+    if (!za) {
+        throw std::runtime_error("无法创建 EPUB (zip) 文件: " + std::to_string(error));
+    }
+
+    // mimetype 必须是第一个条目且不压缩，原书中的 mimetype 可能是压缩存储的，所以解压后重新以 STORE 方式写入
+    zip_int64_t numEntries = zip_get_num_entries(src.get(), 0);
+    zip_int64_t mimetypeIndex = zip_name_locate(src.get(), "mimetype", 0);
+    if (mimetypeIndex < 0) {
+        m_logger->warn("在 {} 中未找到 mimetype 文件，生成的 EPUB 可能无效。", wide2Ascii(epubPath));
+    }
+    else {
+        mimetype = readZipEntry(src.get(), mimetypeIndex);
+        zip_source_t* s = zip_source_buffer(za.get(), mimetype.data(), mimetype.size(), 0);
+        if (!s) {
+            throw std::runtime_error("无法为 mimetype 创建 zip source: " + std::string(zip_strerror(za.get())));
+        }
+        zip_int64_t idx = zip_file_add(za.get(), "mimetype", s, ZIP_FL_ENC_UTF_8);
+        if (idx < 0) {
+            zip_source_free(s);
+            throw std::runtime_error("无法将 mimetype 添加到 zip: " + std::string(zip_strerror(za.get())));
+        }
+        if (zip_set_file_compression(za.get(), idx, ZIP_CM_STORE, 0) < 0) {
+            throw std::runtime_error("无法设置 mimetype 的压缩方式: " + std::string(zip_strerror(za.get())));
+        }
+    }
+
+    for (zip_int64_t idx = 0; idx < numEntries; ++idx) {
+        if (idx == mimetypeIndex) {
+            continue;
+        }
+        const char* name = zip_get_name(src.get(), idx, ZIP_FL_ENC_GUESS);
+        if (!name) {
+            throw std::runtime_error(std::format("无法读取 {} 中的条目名", wide2Ascii(epubPath)));
+        }
+        std::string entryName = name;
+        if (entryName.ends_with('/')) {
+            zip_dir_add(za.get(), entryName.c_str(), ZIP_FL_ENC_UTF_8);
+            continue;
+        }
+
+        // 替换的条目是 replacedEntries 中各个内存 zip 的第 0 个条目，它们在 zip_close 之前一直有效
+        auto it = replacedEntries.find(entryName);
+        zip_source_t* s = it != replacedEntries.end() ?
+            zip_source_zip_file(za.get(), it->second.get(), 0, ZIP_FL_COMPRESSED, 0, -1, nullptr) :
+            zip_source_zip_file(za.get(), src.get(), idx, ZIP_FL_COMPRESSED, 0, -1, nullptr);
+        if (!s) {
+            throw std::runtime_error(std::format("无法为文件 {} 创建 zip source: {}", entryName, zip_strerror(za.get())));
+        }
+        if (zip_file_add(za.get(), entryName.c_str(), s, ZIP_FL_ENC_UTF_8) < 0) {
+            zip_source_free(s);
+            throw std::runtime_error(std::format("无法将文件 {} 添加到 zip: {}", entryName, zip_strerror(za.get())));
+        }
+    }
+
+    // 所有 source 都在 zip_close 中被 libzip 自动管理和释放
+    if (zip_close(za.get()) < 0) {
+        throw std::runtime_error("关闭 zip 存档时出错: " + std::string(zip_strerror(za.get())));
+    }
+    za.release();
 }
@@ -11,6 +11,9 @@ export {
 
 		virtual void makeBar(int totalSentences, int totalThreads) = 0;
 
+		// 输入边准备边翻译时，总句子数在进度条建立后仍会增加
+		virtual void extendBar(int moreSentences) = 0;
+
 		virtual void writeLog(const std::string& log) = 0;
 
 		virtual void addThreadNum() = 0;
@@ -0,0 +1,261 @@
+module;
+
+#include <Windows.h>
+#include <simdjson.h>
+
+export module JsonReader;
+
+import Tool;
+import ZstdCodec;
+
+namespace fs = std::filesystem;
+
+export {
+
+    /**
+    * @brief 只读方式内存映射一个文件，析构时自动解除映射
+    */
+    class MappedFile {
+    private:
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+        HANDLE m_mapping = nullptr;
+        const char* m_data = nullptr;
+        size_t m_size = 0;
+
+    public:
+        explicit MappedFile(const fs::path& path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* data() const { return m_data; }
+        size_t size() const { return m_size; }
+    };
+
+    /**
+    * @brief 读取输入文件(gt_input 格式，包含 name 和 message 的对象数组)
+    * @return 填好 index, hasName, name, original_text 的句子
+    */
+    std::vector<Sentence> readInputJson(const fs::path& path);
+
+    /**
+    * @brief 读取 saveCache 写出的缓存文件，经过 zstd 压缩的文件会先解压
+    * @return 填好缓存中所有字段的句子，complete 均为 true
+    */
+    std::vector<Sentence> readCacheJson(const fs::path& path, const ZstdCodec* codec = nullptr);
+
+    /**
+    * @brief 读取输出文件，name 读入 name_preview，message 读入 translated_preview，src_msg 读入 original_text
+    */
+    std::vector<Sentence> readOutputJson(const fs::path& path);
+}
+
+
+module :private;
+
+MappedFile::MappedFile(const fs::path& path) {
+    m_file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error(std::format("无法打开文件 {}", wide2Ascii(path)));
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_file, &fileSize)) {
+        CloseHandle(m_file);
+        throw std::runtime_error(std::format("无法获取文件 {} 的大小", wide2Ascii(path)));
+    }
+    m_size = (size_t)fileSize.QuadPart;
+    if (m_size == 0) {
+        // 空文件无法创建映射
+        return;
+    }
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) {
+        CloseHandle(m_file);
+        throw std::runtime_error(std::format("无法映射文件 {}", wide2Ascii(path)));
+    }
+    m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data) {
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        throw std::runtime_error(std::format("无法映射文件 {}", wide2Ascii(path)));
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+    }
+}
+
+size_t getPageSize() {
+    static size_t pageSize = []()
+        {
+            SYSTEM_INFO systemInfo;
+            GetSystemInfo(&systemInfo);
+            return (size_t)systemInfo.dwPageSize;
+        }();
+    return pageSize;
+}
+
+/**
+* @brief 映射文件并逐个对象回调
+* simdjson 要求数据后面还有 SIMDJSON_PADDING 个可读字节，映射的最后一页剩余部分足够时直接在映射上解析，
+* 否则复制一份带填充的副本，zstd 压缩的文件解压到带填充的缓冲区中解析
+*/
+void forEachObject(const fs::path& path, const std::function<void(size_t, simdjson::ondemand::object&)>& callback, const ZstdCodec* codec = nullptr) {
+    thread_local simdjson::ondemand::parser parser;
+
+    MappedFile mappedFile(path);
+    const char* data = mappedFile.data();
+    size_t size = mappedFile.size();
+    simdjson::padded_string decompressed;
+    bool isCompressed = isZstdFrame(std::string_view(data, size));
+    if (isCompressed) {
+        try {
+            decompressed = simdjson::padded_string(decompressZstd(std::string_view(data, size), codec));
+        }
+        catch (const std::exception& e) {
+            throw std::runtime_error(std::format("文件 {} 解压失败: {}", wide2Ascii(path), e.what()));
+        }
+        data = decompressed.data();
+        size = decompressed.size();
+    }
+    if (size >= 3 && std::memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        data += 3;
+        size -= 3;
+    }
+
+    try {
+        simdjson::padded_string paddedCopy;
+        simdjson::ondemand::document doc;
+        size_t mappedEnd = mappedFile.size();
+        size_t slack = (getPageSize() - mappedEnd % getPageSize()) % getPageSize();
+        if (isCompressed) {
+            // 解压缓冲区本身带有填充，跳过 BOM 后末尾不变
+            doc = parser.iterate(data, size, size + simdjson::SIMDJSON_PADDING);
+        }
+        else if (mappedEnd != 0 && slack >= simdjson::SIMDJSON_PADDING) {
+            doc = parser.iterate(data, size, size + slack);
+        }
+        else {
+            paddedCopy = simdjson::padded_string(data, size);
+            doc = parser.iterate(paddedCopy);
+        }
+
+        size_t i = 0;
+        for (auto element : doc.get_array()) {
+            simdjson::ondemand::object obj = element.get_object();
+            callback(i, obj);
+            i++;
+        }
+    }
+    catch (const simdjson::simdjson_error& e) {
+        throw std::runtime_error(std::format("文件 {} 解析失败: {}", wide2Ascii(path), e.what()));
+    }
+}
+
+std::vector<Sentence> readInputJson(const fs::path& path) {
+    std::vector<Sentence> sentences;
+    forEachObject(path, [&](size_t i, simdjson::ondemand::object& obj)
+        {
+            Sentence se;
+            se.index = (int)i;
+            bool hasMessage = false;
+            for (auto field : obj) {
+                std::string_view key = field.unescaped_key();
+                if (key == "name") {
+                    se.hasName = true;
+                    se.name = std::string_view(field.value().get_string());
+                }
+                else if (key == "message") {
+                    hasMessage = true;
+                    se.original_text = std::string_view(field.value().get_string());
+                }
+            }
+            if (!hasMessage) {
+                throw std::runtime_error(std::format("[文件 {}] 第 {} 个对象缺少 message 字段。", wide2Ascii(path), i));
+            }
+            sentences.push_back(std::move(se));
+        });
+    return sentences;
+}
+
+std::vector<Sentence> readCacheJson(const fs::path& path, const ZstdCodec* codec) {
+    std::vector<Sentence> sentences;
+    forEachObject(path, [&](size_t i, simdjson::ondemand::object& obj)
+        {
+            Sentence se;
+            se.index = (int)i;
+            se.complete = true;
+            for (auto field : obj) {
+                std::string_view key = field.unescaped_key();
+                if (key == "index") {
+                    se.index = (int)int64_t(field.value().get_int64());
+                }
+                else if (key == "name") {
+                    se.name = std::string_view(field.value().get_string());
+                }
+                else if (key == "name_preview") {
+                    se.name_preview = std::string_view(field.value().get_string());
+                }
+                else if (key == "original_text") {
+                    se.original_text = std::string_view(field.value().get_string());
+                }
+                else if (key == "other_info") {
+                    for (auto infoField : field.value().get_object()) {
+                        std::string infoKey(std::string_view(infoField.unescaped_key()));
+                        se.other_info[infoKey] = std::string_view(infoField.value().get_string());
+                    }
+                }
+                else if (key == "pre_processed_text") {
+                    se.pre_processed_text = std::string_view(field.value().get_string());
+                }
+                else if (key == "pre_translated_text") {
+                    se.pre_translated_text = std::string_view(field.value().get_string());
+                }
+                else if (key == "problem") {
+                    se.problem = std::string_view(field.value().get_string());
+                }
+                else if (key == "translated_by") {
+                    se.translated_by = std::string_view(field.value().get_string());
+                }
+                else if (key == "translated_preview") {
+                    se.translated_preview = std::string_view(field.value().get_string());
+                }
+            }
+            sentences.push_back(std::move(se));
+        }, codec);
+    return sentences;
+}
+
+std::vector<Sentence> readOutputJson(const fs::path& path) {
+    std::vector<Sentence> sentences;
+    forEachObject(path, [&](size_t i, simdjson::ondemand::object& obj)
+        {
+            Sentence se;
+            se.index = (int)i;
+            se.complete = true;
+            for (auto field : obj) {
+                std::string_view key = field.unescaped_key();
+                if (key == "name") {
+                    se.hasName = true;
+                    se.name_preview = std::string_view(field.value().get_string());
+                }
+                else if (key == "message") {
+                    se.translated_preview = std::string_view(field.value().get_string());
+                }
+                else if (key == "src_msg") {
+                    se.original_text = std::string_view(field.value().get_string());
+                }
+            }
+            sentences.push_back(std::move(se));
+        });
+    return sentences;
+}
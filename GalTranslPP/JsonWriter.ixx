@@ -0,0 +1,279 @@
+export module JsonWriter;
+
+import Tool;
+import ZstdCodec;
+
+namespace fs = std::filesystem;
+
+export {
+
+    /**
+    * @brief 边序列化边写入文件的 JSON 写入器，不构建 DOM
+    * 输出格式与 nlohmann::json::dump(indent) 一致，indent 为 -1 时输出紧凑格式
+    * 传入 codec 时写出的内容经过 zstd 流式压缩
+    */
+    class JsonWriter {
+    private:
+        std::ofstream m_ofs;
+        std::optional<ZstdOutputStream> m_zstd;
+        std::string m_buffer;
+        int m_indent;
+        // 每一层数组/对象是否已经写入过元素
+        std::vector<bool> m_hasElements;
+        bool m_afterKey = false;
+
+        void beforeValue();
+        void newline(size_t depth);
+        void writeEscaped(std::string_view str);
+        void flushIfFull();
+
+    public:
+        explicit JsonWriter(const fs::path& path, int indent = 2, const ZstdCodec* codec = nullptr);
+        ~JsonWriter();
+
+        JsonWriter(const JsonWriter&) = delete;
+        JsonWriter& operator=(const JsonWriter&) = delete;
+
+        void beginArray();
+        void endArray();
+        void beginObject();
+        void endObject();
+
+        void key(std::string_view name);
+        void value(std::string_view str);
+        void value(const std::string& str) { value(std::string_view(str)); }
+        void value(const char* str) { value(std::string_view(str)); }
+        void value(long long number);
+        void value(int number) { value((long long)number); }
+        void value(bool boolean);
+
+        template<typename T>
+        void field(std::string_view name, const T& val) {
+            key(name);
+            value(val);
+        }
+
+        void close();
+    };
+
+    /**
+     * @brief 保存缓存，写入一个包含完整句子信息的 JSON 数组
+     */
+    void saveCache(const std::vector<Sentence>& allSentences, const fs::path& cachePath, const ZstdCodec* codec = nullptr);
+
+    /**
+     * @brief 写出翻译结果，字段顺序为 name, message, src_msg
+     */
+    void writeOutputJson(const std::vector<Sentence>& sentences, const fs::path& outputPath, bool outputWithSrc);
+}
+
+
+module :private;
+
+JsonWriter::JsonWriter(const fs::path& path, int indent, const ZstdCodec* codec) : m_indent(indent) {
+    // 不压缩时以文本模式写入，换行和原先用 ofstream 输出 dump() 的结果一致
+    m_ofs.open(path, codec ? std::ios::out | std::ios::binary : std::ios::out);
+    if (!m_ofs.is_open()) {
+        throw std::runtime_error(std::format("无法写入文件 {}", wide2Ascii(path)));
+    }
+    if (codec) {
+        m_zstd.emplace(*codec, m_ofs);
+    }
+    m_buffer.reserve(1 << 20);
+}
+
+JsonWriter::~JsonWriter() {
+    close();
+}
+
+void JsonWriter::close() {
+    if (!m_ofs.is_open()) {
+        return;
+    }
+    if (m_zstd) {
+        m_zstd->write(m_buffer, true);
+        m_zstd.reset();
+    }
+    else {
+        m_ofs.write(m_buffer.data(), m_buffer.size());
+    }
+    m_buffer.clear();
+    m_ofs.close();
+}
+
+void JsonWriter::flushIfFull() {
+    if (m_buffer.size() >= (1 << 20)) {
+        if (m_zstd) {
+            m_zstd->write(m_buffer);
+        }
+        else {
+            m_ofs.write(m_buffer.data(), m_buffer.size());
+        }
+        m_buffer.clear();
+    }
+}
+
+void JsonWriter::newline(size_t depth) {
+    if (m_indent < 0) {
+        return;
+    }
+    m_buffer.push_back('\n');
+    m_buffer.append(depth * m_indent, ' ');
+}
+
+void JsonWriter::beforeValue() {
+    if (m_afterKey) {
+        m_afterKey = false;
+        return;
+    }
+    if (m_hasElements.empty()) {
+        return;
+    }
+    if (m_hasElements.back()) {
+        m_buffer.push_back(',');
+    }
+    m_hasElements.back() = true;
+    newline(m_hasElements.size());
+}
+
+void JsonWriter::writeEscaped(std::string_view str) {
+    m_buffer.push_back('"');
+    for (char c : str) {
+        switch (c) {
+        case '"':
+            m_buffer.append("\\\"");
+            break;
+        case '\\':
+            m_buffer.append("\\\\");
+            break;
+        case '\b':
+            m_buffer.append("\\b");
+            break;
+        case '\f':
+            m_buffer.append("\\f");
+            break;
+        case '\n':
+            m_buffer.append("\\n");
+            break;
+        case '\r':
+            m_buffer.append("\\r");
+            break;
+        case '\t':
+            m_buffer.append("\\t");
+            break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                m_buffer.append(std::format("\\u{:04x}", (unsigned char)c));
+            }
+            else {
+                m_buffer.push_back(c);
+            }
+            break;
+        }
+    }
+    m_buffer.push_back('"');
+}
+
+void JsonWriter::beginArray() {
+    beforeValue();
+    m_buffer.push_back('[');
+    m_hasElements.push_back(false);
+}
+
+void JsonWriter::endArray() {
+    bool hasElements = m_hasElements.back();
+    m_hasElements.pop_back();
+    if (hasElements) {
+        newline(m_hasElements.size());
+    }
+    m_buffer.push_back(']');
+    flushIfFull();
+}
+
+void JsonWriter::beginObject() {
+    beforeValue();
+    m_buffer.push_back('{');
+    m_hasElements.push_back(false);
+}
+
+void JsonWriter::endObject() {
+    bool hasElements = m_hasElements.back();
+    m_hasElements.pop_back();
+    if (hasElements) {
+        newline(m_hasElements.size());
+    }
+    m_buffer.push_back('}');
+    flushIfFull();
+}
+
+void JsonWriter::key(std::string_view name) {
+    beforeValue();
+    writeEscaped(name);
+    m_buffer.append(m_indent < 0 ? ":" : ": ");
+    m_afterKey = true;
+}
+
+void JsonWriter::value(std::string_view str) {
+    beforeValue();
+    writeEscaped(str);
+}
+
+void JsonWriter::value(long long number) {
+    beforeValue();
+    m_buffer.append(std::to_string(number));
+}
+
+void JsonWriter::value(bool boolean) {
+    beforeValue();
+    m_buffer.append(boolean ? "true" : "false");
+}
+
+void saveCache(const std::vector<Sentence>& allSentences, const fs::path& cachePath, const ZstdCodec* codec) {
+    // 键按字母序写入，和之前用 json 对象输出时的顺序相同
+    JsonWriter writer(cachePath, 2, codec);
+    writer.beginArray();
+    for (const auto& se : allSentences) {
+        if (!se.complete) {
+            continue;
+        }
+        writer.beginObject();
+        writer.field("index", se.index);
+        writer.field("name", se.name);
+        writer.field("name_preview", se.name_preview);
+        writer.field("original_text", se.original_text);
+        if (!se.other_info.empty()) {
+            writer.key("other_info");
+            writer.beginObject();
+            for (const auto& [k, v] : se.other_info) {
+                writer.field(k, v);
+            }
+            writer.endObject();
+        }
+        writer.field("pre_processed_text", se.pre_processed_text);
+        writer.field("pre_translated_text", se.pre_translated_text);
+        if (!se.problem.empty()) {
+            writer.field("problem", se.problem);
+        }
+        writer.field("translated_by", se.translated_by);
+        writer.field("translated_preview", se.translated_preview);
+        writer.endObject();
+    }
+    writer.endArray();
+}
+
+void writeOutputJson(const std::vector<Sentence>& sentences, const fs::path& outputPath, bool outputWithSrc) {
+    JsonWriter writer(outputPath);
+    writer.beginArray();
+    for (const auto& se : sentences) {
+        writer.beginObject();
+        if (se.hasName) {
+            writer.field("name", se.name_preview);
+        }
+        writer.field("message", se.translated_preview);
+        if (outputWithSrc) {
+            writer.field("src_msg", se.original_text);
+        }
+        writer.endObject();
+    }
+    writer.endArray();
+}
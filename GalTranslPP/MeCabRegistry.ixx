@@ -0,0 +1,110 @@
+module;
+
+#include <mecab/mecab.h>
+
+export module MeCabRegistry;
+
+import Tool;
+
+namespace fs = std::filesystem;
+
+export {
+
+    /**
+    * @brief 进程内共享的 MeCab 模型表，按字典路径注册，引用计数归零后卸载
+    * Model 本身是线程安全的，各个使用者(或各个线程)从同一个 Model 创建自己的 Tagger 和 Lattice
+    */
+    class MeCabRegistry {
+    private:
+        std::mutex m_mutex;
+        std::map<fs::path, std::weak_ptr<MeCab::Model>> m_models;
+        // 常驻进程中保留已加载的模型，即使暂时没有使用者
+        bool m_keepLoaded = false;
+        std::vector<std::shared_ptr<MeCab::Model>> m_keptModels;
+
+        MeCabRegistry() = default;
+
+    public:
+
+        static MeCabRegistry& instance();
+
+        /**
+        * @brief 取得 dictDir 对应的模型，尚未加载时加载一次
+        */
+        std::shared_ptr<MeCab::Model> acquire(const fs::path& dictDir);
+
+        void setKeepLoaded(bool keepLoaded);
+    };
+
+    /**
+    * @brief 由共享模型创建的分词器，Tagger 和 Lattice 都归自己所有
+    * 不能在多个线程间共享，需要并行分词时每个线程各建一个
+    */
+    class MeCabTokenizer {
+    private:
+        std::shared_ptr<MeCab::Model> m_model;
+        std::unique_ptr<MeCab::Tagger> m_tagger;
+        std::unique_ptr<MeCab::Lattice> m_lattice;
+
+    public:
+
+        explicit MeCabTokenizer(std::shared_ptr<MeCab::Model> model);
+
+        /**
+        * @brief 分词并返回 BOS 节点，节点在下一次 parse 前且 text 未被修改时有效
+        */
+        const MeCab::Node* parse(const std::string& text);
+    };
+}
+
+
+module :private;
+
+MeCabRegistry& MeCabRegistry::instance() {
+    static MeCabRegistry registry;
+    return registry;
+}
+
+std::shared_ptr<MeCab::Model> MeCabRegistry::acquire(const fs::path& dictDir) {
+    fs::path key = fs::absolute(dictDir).lexically_normal();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (auto model = m_models[key].lock()) {
+        return model;
+    }
+    std::shared_ptr<MeCab::Model> model(
+        MeCab::Model::create(("-r BaseConfig/DictGenerator/mecabrc -d " + wide2Ascii(dictDir, 0)).c_str())
+    );
+    if (!model) {
+        throw std::runtime_error("无法初始化 MeCab Model。请确保 BaseConfig/DictGenerator/mecabrc 和 " + wide2Ascii(dictDir) + " 存在且无特殊字符\n"
+            "错误信息: " + MeCab::getLastError());
+    }
+    m_models[key] = model;
+    if (m_keepLoaded) {
+        m_keptModels.push_back(model);
+    }
+    return model;
+}
+
+void MeCabRegistry::setKeepLoaded(bool keepLoaded) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_keepLoaded = keepLoaded;
+    if (!keepLoaded) {
+        m_keptModels.clear();
+    }
+}
+
+MeCabTokenizer::MeCabTokenizer(std::shared_ptr<MeCab::Model> model) : m_model(model) {
+    m_tagger.reset(m_model->createTagger());
+    m_lattice.reset(m_model->createLattice());
+    if (!m_tagger || !m_lattice) {
+        throw std::runtime_error("无法初始化 MeCab Tagger，错误信息: " + std::string(MeCab::getLastError()));
+    }
+}
+
+const MeCab::Node* MeCabTokenizer::parse(const std::string& text) {
+    m_lattice->set_sentence(text.c_str());
+    if (!m_tagger->parse(m_lattice.get())) {
+        throw std::runtime_error(std::format("分词器解析失败，错误信息: {}", m_lattice->what()));
+    }
+    return m_lattice->bos_node();
+}
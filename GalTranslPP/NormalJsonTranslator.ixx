@@ -16,6 +16,11 @@ import APIPool;
 import Dictionary;
 import DictionaryGenerator;
 import ProblemAnalyzer;
+import UsageStatistics;
+import JsonReader;
+import JsonWriter;
+import BinaryCache;
+import ZstdCodec;
 import IPlugin;
 export import ITranslator;
 
@@ -33,9 +38,7 @@ export {
         std::shared_ptr<spdlog::logger> m_logger;
 
         fs::path m_inputDir;
-        fs::path m_inputCacheDir;
         fs::path m_outputDir;
-        fs::path m_outputCacheDir;
         fs::path m_cacheDir;
         fs::path m_projectDir;
 
@@ -45,13 +48,25 @@ export {
         std::string m_dictDir;
 
         int m_totalSentences = 0;
-        int m_completedSentences = 0;
+        std::atomic<int> m_completedSentences = 0;
 
         int m_threadsNum;
         int m_batchSize;
         int m_contextHistorySize;
         int m_maxRetries;
         int m_saveCacheInterval;
+        std::string m_cacheFormat;
+        bool m_zstdCompress;
+        std::unique_ptr<ZstdCodec> m_zstdCodec;
+
+        // 增量重建
+        bool m_incrementalRebuild = false;
+        uint64_t m_rebuildConfigHash = 0;
+        std::vector<fs::path> m_dictPaths;
+        std::set<fs::path> m_rebuiltFiles;
+        std::mutex m_rebuiltFilesMutex;
+        // 译后字典词条指纹 -> 文件 -> 命中该词条的句子在整个文件中的位置
+        std::map<uint64_t, std::map<fs::path, std::set<int>>> m_postDictHits;
         int m_apiTimeOutMs;
         bool m_checkQuota;
         bool m_smartRetry;
@@ -69,40 +84,156 @@ export {
         std::string m_linebreakSymbol;
         std::vector<std::string> m_retranslKeys;
 
+        // 读入内存的输入分片，不分割文件时一个文件就是一个分片
+        struct InputPartition {
+            fs::path relPartPath;  // 分片的相对路径，如 dir1/a_part_0.json，不分割时和 relWholePath 相同
+            fs::path relWholePath; // 原始json的相对路径
+            size_t offset = 0;     // 分片在原始json中的起始位置
+            size_t textBytes = 0;  // 用于按大小排序
+            std::vector<Sentence> sentences;
+            // 各线程只写自己分片的结果，全部完成后再汇总，不需要加锁
+            std::vector<toml::table> problemEntries;
+            std::vector<std::vector<uint64_t>> postDictHits;
+        };
+        // 流水线模式下生产者线程会在翻译进行时追加分片，deque 追加时不会使已有元素的引用失效
+        std::deque<InputPartition> m_partitions;
+        std::mutex m_partitionsMutex;
+
         bool m_needsCombining = false;
-        // 输入分割文件相对路径到原始json相对路径的映射
-        std::map<fs::path, fs::path> m_splitFilePartsToJson;
-        // 原始json相对路径到多个输入分割文件相对路径及其有没有完成的映射
-        std::map<fs::path, std::map<fs::path, bool>> m_jsonToSplitFileParts;
+        // 分割模式下每个原始json的结果，各分片完成后按偏移放入，最后一个分片完成时统一写出
+        struct SplitFileResult {
+            std::vector<Sentence> sentences;
+            int remainingParts = 0;
+        };
+        std::map<fs::path, SplitFileResult> m_splitFileResults;
+        std::mutex m_splitFileResultsMutex;
 
         std::map<std::string, std::string> m_nameMap;
         std::mutex m_cacheMutex;
-        std::mutex m_outputCacheFileMutex;
         toml::table m_problemOverview = toml::table{ {"problemOverview", toml::array{}} };
         std::function<void(fs::path)> m_onFileProcessed;
+        // 输入生产者：设置后由 run() 调用，每准备好一批输入 json 就把它们的相对路径交给 feed
+        // 需要请求 API 的模式下这批文件立即开始翻译，其余模式等生产者全部完成后再统一读取
+        std::function<void(const std::function<void(const std::vector<fs::path>&)>&)> m_inputProducer;
 
         APIPool m_apiPool;
+        UsageStatistics m_usageStatistics;
         GptDictionary m_gptDictionary;
         NormalDictionary m_preDictionary;
         NormalDictionary m_postDictionary;
         ProblemAnalyzer m_problemAnalyzer;
         std::vector<std::shared_ptr<IPlugin>> m_prePlugins;
         std::vector<std::shared_ptr<IPlugin>> m_postPlugins;
+
+        // DryRun 模式下每个文件的预估结果
+        struct DryRunStat {
+            int sentences = 0;
+            int cacheHits = 0;
+            int requests = 0;
+            long long promptTokens = 0;
+            long long completionTokens = 0;
+        };
+        TransEngine m_dryRunEngine = TransEngine::ForGalJson;
+        double m_dryRunOutputRatio;
+        double m_dryRunTokensPerSecond;
+        double m_dryRunRequestLatency;
+        int m_dryRunRequestsPerMinute;
+        int m_dryRunTokensPerMinute;
+        std::vector<int> m_dryRunThreadsNums;
+        std::map<fs::path, DryRunStat> m_dryRunStats;
+        std::mutex m_dryRunMutex;
         
 
     private:
         void preProcess(Sentence* se);
 
-        void postProcess(Sentence* se);
+        void postProcess(Sentence* se, std::vector<uint64_t>* postDictHits = nullptr);
+
+        json buildMessages(const std::vector<Sentence*>& batchToTransThisRound, TransEngine transEngine, const std::string& glossary, const std::string& contextHistory,
+            std::map<int, Sentence*>& id2SentenceMap, std::string& inputProblems, std::string& inputBlock);
+
+        bool translateBatchWithRetry(const fs::path& relInputPath, std::vector<Sentence*>& batch, int threadId, const std::string& firstReason = "首次请求");
+
+        void estimateFile(const fs::path& relInputPath, size_t sentenceCount, const std::vector<Sentence*>& toTranslate);
+
+        void reportDryRun(const std::vector<fs::path>& relInputPaths);
+
+        /**
+        * @brief 不发请求的模式只受 CPU 限制，按核心数开线程，threadsNum 只用来限制 API 并发
+        */
+        int getWorkerThreadsNum() const
+        {
+            if (m_transEngine == TransEngine::Rebuild || m_transEngine == TransEngine::ShowNormal || m_transEngine == TransEngine::DryRun ||
+                m_transEngine == TransEngine::DumpName) {
+                return std::max(1, (int)std::thread::hardware_concurrency());
+            }
+            return m_threadsNum;
+        }
+
+        std::wstring getCacheExtension() const { return m_cacheFormat == "binary" ? L".gtc" : L".json"; }
+
+        const ZstdCodec* getWriteCodec() const { return m_zstdCompress ? m_zstdCodec.get() : nullptr; }
+
+        void saveCacheFile(const std::vector<Sentence>& allSentences, const fs::path& cachePath);
+
+        /**
+        * @brief 分割模式下翻译时各线程会读取其它分片的缓存，此时缓存的读写需要加锁，其余情况各文件互不相干
+        */
+        std::unique_lock<std::mutex> lockSharedCache()
+        {
+            return m_needsCombining && m_transEngine != TransEngine::Rebuild ? std::unique_lock<std::mutex>(m_cacheMutex) : std::unique_lock<std::mutex>();
+        }
+
+        void trainZstdDictionary();
+
+        toml::table makeProblemEntry(const std::string& filename, const Sentence& se);
+
+        uint64_t computeRebuildGlobalHash();
+
+        std::optional<uint64_t> computeRebuildFileHash(const fs::path& relWholePath, const std::vector<fs::path>& relPartPaths);
+
+        std::set<fs::path> skipUnchangedFiles(const json& manifest, uint64_t globalHash, const std::map<fs::path, std::vector<fs::path>>& fileParts);
+
+        void patchPostDictChanges(const fs::path& relWholePath, const std::vector<fs::path>& relPartPaths, std::vector<std::vector<Sentence>>& partCaches,
+            const std::unordered_set<uint64_t>& removedEntries, bool recheckAll);
+
+        void saveRebuildManifest(const json& oldManifest, uint64_t globalHash, const std::set<fs::path>& skippedFiles,
+            const std::map<fs::path, std::vector<fs::path>>& fileParts);
+
+        void migrateCacheFormat();
+
+        void processFile(size_t partitionIndex, int threadId);
+
+        bool usesTranslationApi() const
+        {
+            return m_transEngine != TransEngine::Rebuild && m_transEngine != TransEngine::ShowNormal && m_transEngine != TransEngine::DryRun &&
+                m_transEngine != TransEngine::DumpName && m_transEngine != TransEngine::GenDict;
+        }
+
+        std::vector<Sentence> readInputFile(const fs::path& inputPath);
+
+        void countNames(const std::vector<Sentence>& sentences, std::map<std::string, int>& nameCounts);
 
-        bool translateBatchWithRetry(const fs::path& relInputPath, std::vector<Sentence*>& batch, int threadId);
+        /**
+        * @brief 按分割设置把一个输入文件切成分片追加到 m_partitions，返回新分片的下标
+        */
+        std::vector<size_t> addInputPartitions(const fs::path& relWholePath, std::vector<Sentence>& fileSentences);
 
-        void processFile(const fs::path& inputPath, int threadId);
+        void sortPartitionOrder(std::vector<size_t>& partitionOrder);
+
+        void writeNameTable(std::map<std::string, int>& nameTableMap);
+
+        void loadNameTable();
+
+        /**
+        * @brief 边接收生产者的输入边翻译，返回分片的派发顺序
+        */
+        std::vector<size_t> translatePipelined(std::map<std::string, int>& nameTableMap, bool needGenerateNameTable);
 
 	public:
         NormalJsonTranslator(const fs::path& projectDir, std::shared_ptr<IController> controller, std::shared_ptr<spdlog::logger> logger,
-            std::optional<fs::path> inputDir = std::nullopt, std::optional<fs::path> inputCacheDir = std::nullopt,
-            std::optional<fs::path> outputDir = std::nullopt, std::optional<fs::path> outputCacheDir = std::nullopt);
+            std::optional<fs::path> inputDir = std::nullopt,
+            std::optional<fs::path> outputDir = std::nullopt);
 
         virtual ~NormalJsonTranslator()
         {
@@ -116,15 +247,13 @@ export {
 module :private;
 
 NormalJsonTranslator::NormalJsonTranslator(const fs::path& projectDir, std::shared_ptr<IController> controller, std::shared_ptr<spdlog::logger> logger,
-    std::optional<fs::path> inputDir, std::optional<fs::path> inputCacheDir,
-    std::optional<fs::path> outputDir, std::optional<fs::path> outputCacheDir) :
+    std::optional<fs::path> inputDir,
+    std::optional<fs::path> outputDir) :
     m_projectDir(projectDir), m_controller(controller), m_logger(logger),
-    m_apiPool(logger), m_gptDictionary(logger), m_preDictionary(logger), m_postDictionary(logger), m_problemAnalyzer(logger)
+    m_apiPool(logger), m_usageStatistics(logger), m_gptDictionary(logger), m_preDictionary(logger), m_postDictionary(logger), m_problemAnalyzer(logger)
 {
     m_inputDir = inputDir.value_or(m_projectDir / L"gt_input");
-    m_inputCacheDir = inputCacheDir.value_or(L"cache" / m_projectDir.filename() / L"gt_input_cache");
     m_outputDir = outputDir.value_or(m_projectDir / L"gt_output");
-    m_outputCacheDir = outputCacheDir.value_or(L"cache" / m_projectDir.filename() / L"gt_output_cache");
     m_cacheDir = m_projectDir / L"transl_cache";
 
     std::ifstream ifs;
@@ -165,6 +294,9 @@ NormalJsonTranslator::NormalJsonTranslator(const fs::path& projectDir, std::shar
         else if (transEngineStr == "ShowNormal") {
             m_transEngine = TransEngine::ShowNormal;
         }
+        else if (transEngineStr == "DryRun") {
+            m_transEngine = TransEngine::DryRun;
+        }
         else {
             throw std::runtime_error("Invalid trans engine");
         }
@@ -177,8 +309,50 @@ NormalJsonTranslator::NormalJsonTranslator(const fs::path& projectDir, std::shar
         int apiTimeOutSecond = configData["backendSpecific"]["OpenAI-Compatible"]["apiTimeout"].value_or(60);
         m_apiTimeOutMs = apiTimeOutSecond * 1000;
 
+        if (m_transEngine == TransEngine::DryRun) {
+            std::string simulateEngineStr = configData["dryRun"]["simulateEngine"].value_or("ForGalJson");
+            if (simulateEngineStr == "ForGalJson") {
+                m_dryRunEngine = TransEngine::ForGalJson;
+            }
+            else if (simulateEngineStr == "ForGalTsv") {
+                m_dryRunEngine = TransEngine::ForGalTsv;
+            }
+            else if (simulateEngineStr == "ForNovelTsv") {
+                m_dryRunEngine = TransEngine::ForNovelTsv;
+            }
+            else if (simulateEngineStr == "DeepseekJson") {
+                m_dryRunEngine = TransEngine::DeepseekJson;
+            }
+            else if (simulateEngineStr == "Sakura") {
+                m_dryRunEngine = TransEngine::Sakura;
+            }
+            else {
+                throw std::invalid_argument("dryRun.simulateEngine 只能是 ForGalJson, ForGalTsv, ForNovelTsv, DeepseekJson 或 Sakura");
+            }
+            m_dryRunOutputRatio = configData["dryRun"]["outputTokenRatio"].value_or(1.0);
+            m_dryRunTokensPerSecond = configData["dryRun"]["tokensPerSecond"].value_or(30.0);
+            m_dryRunRequestLatency = configData["dryRun"]["requestLatency"].value_or(2.0);
+            m_dryRunRequestsPerMinute = configData["dryRun"]["requestsPerMinute"].value_or(0);
+            m_dryRunTokensPerMinute = configData["dryRun"]["tokensPerMinute"].value_or(0);
+            auto threadsNums = configData["dryRun"]["threadsNums"].as_array();
+            if (threadsNums) {
+                threadsNums->for_each([&](auto&& el)
+                    {
+                        if constexpr (toml::is_integer<decltype(el)>) {
+                            if (*el > 0) {
+                                m_dryRunThreadsNums.push_back((int)*el);
+                            }
+                        }
+                    });
+            }
+            if (m_dryRunThreadsNums.empty()) {
+                m_dryRunThreadsNums = { 1, 2, 4, 8, 16 };
+            }
+        }
+
         // 需要API
-        if (m_transEngine != TransEngine::DumpName && m_transEngine != TransEngine::Rebuild && m_transEngine != TransEngine::ShowNormal) {
+        if (m_transEngine != TransEngine::DumpName && m_transEngine != TransEngine::Rebuild && m_transEngine != TransEngine::ShowNormal &&
+            m_transEngine != TransEngine::DryRun) {
             auto translationAPIs = configData["backendSpecific"]["OpenAI-Compatible"]["apis"].as_array();
             if (!translationAPIs) {
                 throw std::invalid_argument("OpenAI-Compatible apis not found in config.toml");
@@ -213,6 +387,7 @@ NormalJsonTranslator::NormalJsonTranslator(const fs::path& projectDir, std::shar
                             return;
                         }
                         translationAPI.stream = el["stream"].value_or(false);
+                        translationAPI.streamUsage = el["streamUsage"].value_or(true);
                         translationAPI.lastReportTime = std::chrono::steady_clock::now();
                         m_translationAPIs.push_back(translationAPI);
                     }
@@ -264,6 +439,13 @@ NormalJsonTranslator::NormalJsonTranslator(const fs::path& projectDir, std::shar
         m_splitFile = configData["common"]["splitFile"].value_or("no");
         m_splitFileNum = configData["common"]["splitFileNum"].value_or(25);
         m_saveCacheInterval = configData["common"]["saveCacheInterval"].value_or(1);
+        m_cacheFormat = configData["common"]["cacheFormat"].value_or("json");
+        if (m_cacheFormat != "json" && m_cacheFormat != "binary") {
+            throw std::invalid_argument("common.cacheFormat 只能是 json 或 binary");
+        }
+        // 关闭压缩时也要加载字典，以便读取之前压缩过的文件
+        m_zstdCompress = configData["common"]["zstdCompress"].value_or(false);
+        m_zstdCodec = std::make_unique<ZstdCodec>(m_projectDir / L"zstd.dict", configData["common"]["zstdLevel"].value_or(3));
         m_linebreakSymbol = configData["common"]["linebreakSymbol"].value_or("auto");
         m_maxRetries = configData["common"]["maxRetries"].value_or(5);
         m_contextHistorySize = configData["common"]["contextHistorySize"].value_or(8);
@@ -319,6 +501,7 @@ NormalJsonTranslator::NormalJsonTranslator(const fs::path& projectDir, std::shar
                         }
                         if (fs::exists(dictPath)) {
                             m_gptDictionary.loadFromFile(dictPath);
+                            m_dictPaths.push_back(dictPath);
                         }
                     }
                 });
@@ -335,6 +518,7 @@ NormalJsonTranslator::NormalJsonTranslator(const fs::path& projectDir, std::shar
                         }
                         if (fs::exists(dictPath)) {
                             m_preDictionary.loadFromFile(dictPath);
+                            m_dictPaths.push_back(dictPath);
                         }
                     }
                 });
@@ -360,6 +544,26 @@ NormalJsonTranslator::NormalJsonTranslator(const fs::path& projectDir, std::shar
         m_gptDictionary.sort();
         m_postDictionary.sort();
 
+        if (m_transEngine == TransEngine::Rebuild) {
+            m_incrementalRebuild = configData["common"]["incrementalRebuild"].value_or(true);
+            // 去掉只影响翻译请求、调度和存储方式的设置，剩下的才参与增量重建的哈希
+            toml::table relevantConfig = configData;
+            relevantConfig.erase("backendSpecific");
+            relevantConfig.erase("dryRun");
+            if (auto plugins = relevantConfig["plugins"].as_table()) {
+                plugins->erase("transEngine");
+            }
+            if (auto common = relevantConfig["common"].as_table()) {
+                for (const char* key : { "numPerRequestTranslate", "threadsNum", "sortMethod", "saveCacheInterval", "maxRetries", "contextHistorySize",
+                    "smartRetry", "checkQuota", "logLevel", "saveLog", "cacheFormat", "zstdCompress", "zstdLevel", "incrementalRebuild" }) {
+                    common->erase(key);
+                }
+            }
+            std::stringstream ss;
+            ss << relevantConfig;
+            m_rebuildConfigHash = fnv1a64(ss.str());
+        }
+
         if (m_transEngine == TransEngine::DumpName || m_transEngine == TransEngine::Rebuild || m_transEngine == TransEngine::ShowNormal) {
             // 这几个不需要加载提示词
             return;
@@ -380,7 +584,8 @@ NormalJsonTranslator::NormalJsonTranslator(const fs::path& projectDir, std::shar
         std::string systemKey;
         std::string userKey;
 
-        switch (m_transEngine) {
+        // DryRun 使用所模拟的翻译模式的提示词
+        switch (m_transEngine == TransEngine::DryRun ? m_dryRunEngine : m_transEngine) {
         case TransEngine::ForGalJson:
             systemKey = "FORGALJSON_SYSTEM";
             userKey = "FORGALJSON_TRANS_PROMPT_EN";
@@ -491,7 +696,7 @@ void NormalJsonTranslator::preProcess(Sentence* se) {
 
 }
 
-void NormalJsonTranslator::postProcess(Sentence* se) {
+void NormalJsonTranslator::postProcess(Sentence* se, std::vector<uint64_t>* postDictHits) {
 
     se->name_preview = se->name;
     se->translated_preview = se->pre_translated_text;
@@ -501,7 +706,7 @@ void NormalJsonTranslator::postProcess(Sentence* se) {
     }
 
     if (m_usePostDictInMsg) {
-        se->translated_preview = m_postDictionary.doReplace(se, CachePart::TransPreview);
+        se->translated_preview = m_postDictionary.doReplace(se, CachePart::TransPreview, postDictHits);
     }
     replaceStrInplace(se->translated_preview, "<tab>", "\t");
     if (!se->originalLinebreak.empty()) {
@@ -519,15 +724,41 @@ void NormalJsonTranslator::postProcess(Sentence* se) {
             }
         }
         if (m_usePostDictInName) {
-            se->name_preview = m_postDictionary.doReplace(se, CachePart::NamePreview);
+            se->name_preview = m_postDictionary.doReplace(se, CachePart::NamePreview, postDictHits);
         }
     }
 
     m_problemAnalyzer.analyze(se, m_gptDictionary, m_targetLang);
 }
 
+json NormalJsonTranslator::buildMessages(const std::vector<Sentence*>& batchToTransThisRound, TransEngine transEngine, const std::string& glossary, const std::string& contextHistory,
+    std::map<int, Sentence*>& id2SentenceMap, std::string& inputProblems, std::string& inputBlock) {
+
+    for (auto pSentence : batchToTransThisRound) {
+        if (!pSentence->problem.empty() && inputProblems.find(pSentence->problem) == std::string::npos) {
+            inputProblems += pSentence->problem + "\n";
+        }
+    }
 
-bool NormalJsonTranslator::translateBatchWithRetry(const fs::path& relInputPath, std::vector<Sentence*>& batch, int threadId) {
+    fillBlockAndMap(batchToTransThisRound, id2SentenceMap, inputBlock, transEngine);
+
+    std::string promptReq = m_userPrompt;
+    promptReq = boost::regex_replace(promptReq, boost::regex(R"(\[Problem Description\])"), inputProblems);
+    promptReq = boost::regex_replace(promptReq, boost::regex(R"(\[Input\])"), inputBlock);
+    promptReq = boost::regex_replace(promptReq, boost::regex(R"(\[TargetLang\])"), m_targetLang);
+    promptReq = boost::regex_replace(promptReq, boost::regex(R"(\[Glossary\])"), glossary);
+
+    json messages = json::array({ {{"role", "system"}, {"content", m_systemPrompt}} });
+    if (!contextHistory.empty()) {
+        messages.push_back({ {"role", "user"}, {"content", "<input>(...truncated history source texts...)</input><output>\n"} });
+        messages.push_back({ {"role", "assistant"}, {"content", contextHistory} });
+    }
+    messages.push_back({ {"role", "user"}, {"content", promptReq} });
+    return messages;
+}
+
+
+bool NormalJsonTranslator::translateBatchWithRetry(const fs::path& relInputPath, std::vector<Sentence*>& batch, int threadId, const std::string& firstReason) {
 
     if (batch.empty()) {
         return true;
@@ -541,6 +772,9 @@ bool NormalJsonTranslator::translateBatchWithRetry(const fs::path& relInputPath,
     }
 
     int retryCount = 0;
+    // 本次请求是因为什么原因发出的，用于用量统计
+    std::string requestReason = firstReason;
+    std::string relInputPathStr = wide2Ascii(relInputPath);
     std::string contextHistory = buildContextHistory(batch, m_transEngine, m_contextHistorySize);
     std::string glossary = m_gptDictionary.generatePrompt(batch, m_transEngine);
 
@@ -568,41 +802,24 @@ bool NormalJsonTranslator::translateBatchWithRetry(const fs::path& relInputPath,
             std::vector<Sentence*> firstHalf(batchToTransThisRound.begin(), batchToTransThisRound.begin() + mid);
             std::vector<Sentence*> secondHalf(batchToTransThisRound.begin() + mid, batchToTransThisRound.end());
 
-            bool firstOk = translateBatchWithRetry(relInputPath, firstHalf, threadId);
-            bool secondOk = translateBatchWithRetry(relInputPath, secondHalf, threadId);
+            bool firstOk = translateBatchWithRetry(relInputPath, firstHalf, threadId, "拆分批次");
+            bool secondOk = translateBatchWithRetry(relInputPath, secondHalf, threadId, "拆分批次");
 
             return firstOk && secondOk;
         }
         else if (m_smartRetry && retryCount == 3) {
             m_logger->warn("[线程 {}] [文件 {}] 清空上下文后再次尝试...", threadId, wide2Ascii(relInputPath));
             contextHistory.clear();
+            requestReason = "清空上下文";
         }
 
 
         std::string inputProblems;
-        for (auto pSentence : batchToTransThisRound) {
-            if (!pSentence->problem.empty() && inputProblems.find(pSentence->problem) == std::string::npos) {
-                inputProblems += pSentence->problem + "\n";
-            }
-        }
-
         std::string inputBlock;
         std::map<int, Sentence*> id2SentenceMap; // 用于 TSV/JSON 
-        fillBlockAndMap(batchToTransThisRound, id2SentenceMap, inputBlock, m_transEngine);
+        json messages = buildMessages(batchToTransThisRound, m_transEngine, glossary, contextHistory, id2SentenceMap, inputProblems, inputBlock);
 
         m_logger->info("[线程 {}] [文件 {}] 开始翻译\nProblems:\n{}\nDict:\n{}\ninputBlock:\n{}", threadId, wide2Ascii(relInputPath), inputProblems, glossary, inputBlock);
-        std::string promptReq = m_userPrompt;
-        promptReq = boost::regex_replace(promptReq, boost::regex(R"(\[Problem Description\])"), inputProblems);
-        promptReq = boost::regex_replace(promptReq, boost::regex(R"(\[Input\])"), inputBlock);
-        promptReq = boost::regex_replace(promptReq, boost::regex(R"(\[TargetLang\])"), m_targetLang);
-        promptReq = boost::regex_replace(promptReq, boost::regex(R"(\[Glossary\])"), glossary);
-
-        json messages = json::array({ {{"role", "system"}, {"content", m_systemPrompt}} });
-        if (!contextHistory.empty()) {
-            messages.push_back({ {"role", "user"}, {"content", "<input>(...truncated history source texts...)</input><output>\n"} });
-            messages.push_back({ {"role", "assistant"}, {"content", contextHistory} });
-        }
-        messages.push_back({ {"role", "user"}, {"content", promptReq} });
 
         auto optAPI = m_apiStrategy == "random" ? m_apiPool.getAPI() : m_apiPool.getFirstAPI();
         if (!optAPI.has_value()) {
@@ -613,6 +830,7 @@ bool NormalJsonTranslator::translateBatchWithRetry(const fs::path& relInputPath,
         json payload = { {"model", currentAPI.modelName}, {"messages", messages} };
 
         ApiResponse response = performApiRequest(payload, currentAPI, threadId, m_controller, m_logger, m_apiTimeOutMs);
+        m_usageStatistics.record(currentAPI, relInputPathStr, requestReason, response);
         if (!response.success) {
 
             std::string lowerErrorMsg = response.content;
@@ -627,6 +845,7 @@ bool NormalJsonTranslator::translateBatchWithRetry(const fs::path& relInputPath,
             {
                 m_logger->error("[线程 {}] API Key [{}] 疑似额度用尽，短期内多次报告将从池中移除。", threadId, currentAPI.apikey);
                 m_apiPool.reportProblem(currentAPI);
+                requestReason = "额度用尽";
                 // 不需要增加 retryCount
                 continue;
             }
@@ -634,6 +853,7 @@ bool NormalJsonTranslator::translateBatchWithRetry(const fs::path& relInputPath,
             else if (lowerErrorMsg.find("no available") != std::string::npos) {
                 m_logger->error("[线程 {}] API Key [{}] 没有 [{}] 模型，短期内多次报告将从池中移除。", threadId, currentAPI.apikey, currentAPI.modelName);
                 m_apiPool.reportProblem(currentAPI);
+                requestReason = "模型不可用";
                 continue;
             }
 
@@ -641,6 +861,7 @@ bool NormalJsonTranslator::translateBatchWithRetry(const fs::path& relInputPath,
             // 状态码 429 是最明确的信号
             if (response.statusCode == 429 || lowerErrorMsg.find("rate limit") != std::string::npos || lowerErrorMsg.find("try again") != std::string::npos) {
                 retryCount++;
+                requestReason = "频率限制";
                 m_logger->warn("[线程 {}] [文件 {}] 遇到频率限制或可重试错误，进行第 {} 次退避等待...", threadId, wide2Ascii(relInputPath.filename()), retryCount);
 
                 // 实现指数退避与抖动
@@ -661,6 +882,7 @@ bool NormalJsonTranslator::translateBatchWithRetry(const fs::path& relInputPath,
 
             // 其他无法识别的硬性错误
             retryCount++;
+            requestReason = "未知API错误";
             m_logger->warn("[线程 {}] [文件 {}] 遇到未知API错误，进行第 {} 次重试...", threadId, wide2Ascii(relInputPath.filename()), retryCount);
             if (m_apiStrategy == "fallback") {
                 m_logger->warn("[线程 {}] 将切换到下一个 API Key(如果有多个API Key的话)", threadId);
@@ -681,6 +903,7 @@ bool NormalJsonTranslator::translateBatchWithRetry(const fs::path& relInputPath,
 
         if (parseError || parsedCount != batchToTransThisRound.size()) {
             retryCount++;
+            requestReason = "解析失败";
             m_logger->warn("[线程 {}] [文件 {}] 解析失败或不完整 ({} / {}), 进行第 {} 次重试...", threadId, wide2Ascii(relInputPath.filename()), parsedCount, batchToTransThisRound.size(), retryCount);
             continue;
         }
@@ -703,87 +926,222 @@ bool NormalJsonTranslator::translateBatchWithRetry(const fs::path& relInputPath,
 }
 
 
+// ============================================        DryRun        ========================================
+void NormalJsonTranslator::estimateFile(const fs::path& relInputPath, size_t sentenceCount, const std::vector<Sentence*>& toTranslate) {
+    DryRunStat stat;
+    stat.sentences = (int)sentenceCount;
+    stat.cacheHits = (int)(sentenceCount - toTranslate.size());
+
+    // 与 translateBatchWithRetry 相同的分批和提示词构建，只是不发送请求
+    for (size_t i = 0; i < toTranslate.size(); i += m_batchSize) {
+        if (m_controller->shouldStop()) {
+            return;
+        }
+        std::vector<Sentence*> batch(toTranslate.begin() + i, toTranslate.begin() + std::min(i + m_batchSize, toTranslate.size()));
+        for (auto pSentence : batch) {
+            if (pSentence->pre_processed_text.empty()) {
+                pSentence->complete = true;
+            }
+            m_completedSentences++;
+            m_controller->updateBar(); // 预估
+        }
+
+        std::string contextHistory = buildContextHistory(batch, m_dryRunEngine, m_contextHistorySize);
+        std::string glossary = m_gptDictionary.generatePrompt(batch, m_dryRunEngine);
+
+        std::vector<Sentence*> batchToTransThisRound;
+        for (auto pSentence : batch) {
+            if (!pSentence->complete) {
+                batchToTransThisRound.push_back(pSentence);
+            }
+        }
+        if (batchToTransThisRound.empty()) {
+            continue;
+        }
+
+        std::string inputProblems;
+        std::string inputBlock;
+        std::map<int, Sentence*> id2SentenceMap;
+        json messages = buildMessages(batchToTransThisRound, m_dryRunEngine, glossary, contextHistory, id2SentenceMap, inputProblems, inputBlock);
+
+        stat.requests++;
+        for (const auto& message : messages) {
+            stat.promptTokens += estimateTokens(message["content"].get<std::string>()) + 4; // 每条消息的格式开销
+        }
+        // 回复的格式与输入块基本一致，只是原文换成了译文
+        stat.completionTokens += (long long)(estimateTokens(inputBlock) * m_dryRunOutputRatio);
+
+        // 假定译文和原文等长，让后续批次携带的上文长度接近真实翻译时的情况
+        for (auto pSentence : batchToTransThisRound) {
+            pSentence->pre_translated_text = pSentence->pre_processed_text;
+            pSentence->complete = true;
+        }
+    }
+
+    m_logger->debug("[文件 {}] 预计请求 {} 次，输入 {} tokens，输出 {} tokens", wide2Ascii(relInputPath), stat.requests, stat.promptTokens, stat.completionTokens);
+    std::lock_guard<std::mutex> lock(m_dryRunMutex);
+    m_dryRunStats[relInputPath] = stat;
+}
+
+void NormalJsonTranslator::reportDryRun(const std::vector<fs::path>& relInputPaths) {
+    auto formatDuration = [](double seconds)
+        {
+            long long totalSeconds = (long long)std::ceil(seconds);
+            return std::format("{:02}:{:02}:{:02}", totalSeconds / 3600, totalSeconds % 3600 / 60, totalSeconds % 60);
+        };
+
+    DryRunStat total;
+    std::vector<double> fileSeconds; // 按分发顺序排列的每个文件的预计耗时
+    json filesJson = json::object();
+    for (const auto& relInputPath : relInputPaths) {
+        auto it = m_dryRunStats.find(relInputPath);
+        if (it == m_dryRunStats.end()) {
+            continue;
+        }
+        const DryRunStat& stat = it->second;
+        // 同一个文件内的请求是串行的
+        double seconds = stat.requests * m_dryRunRequestLatency + (m_dryRunTokensPerSecond > 0 ? stat.completionTokens / m_dryRunTokensPerSecond : 0.0);
+        fileSeconds.push_back(seconds);
+        total.sentences += stat.sentences;
+        total.cacheHits += stat.cacheHits;
+        total.requests += stat.requests;
+        total.promptTokens += stat.promptTokens;
+        total.completionTokens += stat.completionTokens;
+        filesJson[wide2Ascii(relInputPath)] = {
+            {"sentences", stat.sentences},
+            {"cacheHits", stat.cacheHits},
+            {"requests", stat.requests},
+            {"promptTokens", stat.promptTokens},
+            {"completionTokens", stat.completionTokens},
+            {"seconds", seconds},
+        };
+    }
+
+    m_logger->info("预估结果: 共 {} 句，命中缓存 {} 句，需请求 {} 次，预计输入 {} tokens，输出 {} tokens",
+        total.sentences, total.cacheHits, total.requests, total.promptTokens, total.completionTokens);
+
+    json projectionsJson = json::array();
+    for (int threadsNum : m_dryRunThreadsNums) {
+        // 和线程池一样，哪个线程先空闲就把下一个文件交给它
+        std::priority_queue<double, std::vector<double>, std::greater<double>> threadFinishTimes;
+        for (int i = 0; i < threadsNum; ++i) {
+            threadFinishTimes.push(0.0);
+        }
+        double wallSeconds = 0.0;
+        for (double seconds : fileSeconds) {
+            double finishTime = threadFinishTimes.top() + seconds;
+            threadFinishTimes.pop();
+            threadFinishTimes.push(finishTime);
+            wallSeconds = std::max(wallSeconds, finishTime);
+        }
+        // 每分钟请求数和 token 数的限制由所有线程共享
+        if (m_dryRunRequestsPerMinute > 0) {
+            wallSeconds = std::max(wallSeconds, total.requests * 60.0 / m_dryRunRequestsPerMinute);
+        }
+        if (m_dryRunTokensPerMinute > 0) {
+            wallSeconds = std::max(wallSeconds, (total.promptTokens + total.completionTokens) * 60.0 / m_dryRunTokensPerMinute);
+        }
+        projectionsJson.push_back({ {"threadsNum", threadsNum}, {"seconds", wallSeconds}, {"duration", formatDuration(wallSeconds)} });
+        m_logger->info("线程数 {}: 预计耗时 {}", threadsNum, formatDuration(wallSeconds));
+    }
+
+    json dryRunJson = {
+        {"total", {
+            {"sentences", total.sentences},
+            {"cacheHits", total.cacheHits},
+            {"requests", total.requests},
+            {"promptTokens", total.promptTokens},
+            {"completionTokens", total.completionTokens},
+        }},
+        {"projections", projectionsJson},
+        {"files", filesJson},
+    };
+    std::ofstream ofs(m_projectDir / L"翻译预估.json");
+    ofs << dryRunJson.dump(2);
+    ofs.close();
+    m_logger->info("已生成 翻译预估.json 文件");
+}
+
+
 // ============================================        processFile        ========================================
-void NormalJsonTranslator::processFile(const fs::path& inputPath, int threadId) {
+void NormalJsonTranslator::processFile(size_t partitionIndex, int threadId) {
     if (m_controller->shouldStop()) {
         return;
     }
-    m_logger->debug("[线程 {}] 开始处理文件: {}", threadId, wide2Ascii(inputPath));
+    InputPartition& partition = [&]() -> InputPartition&
+        {
+            std::lock_guard<std::mutex> lock(m_partitionsMutex);
+            return m_partitions[partitionIndex];
+        }();
+    fs::path relInputPath = partition.relPartPath;
+    m_logger->debug("[线程 {}] 开始处理文件: {}", threadId, wide2Ascii(relInputPath));
     m_controller->addThreadNum();
 
-    std::ifstream ifs;
-    fs::path relInputPath = fs::relative(inputPath, m_needsCombining ? m_inputCacheDir : m_inputDir);
-    fs::path outputPath = m_needsCombining ? (m_outputCacheDir / relInputPath) : (m_outputDir / relInputPath);
+    fs::path outputPath = m_outputDir / partition.relWholePath;
     fs::path cachePath = m_cacheDir / relInputPath;
+    cachePath.replace_extension(getCacheExtension());
     fs::path showNormalPath = m_projectDir / L"gt_show_normal" / relInputPath;
     createParent(outputPath);
     createParent(cachePath);
 
-    std::vector<Sentence> sentences;
-    try {
-        ifs.open(inputPath);
-        json data = json::parse(ifs);
-        ifs.close();
-        for (size_t i = 0; i < data.size(); ++i) {
-            const auto& item = data[i];
-            Sentence se;
-            se.index = (int)i;
-            if (item.contains("name")) {
-                se.hasName = true;
-                se.name = item.value("name", "");
-            }
-            if (!item.contains("message")) {
-                throw std::runtime_error(std::format("[线程 {}] [文件 {}] 第 {} 个对象缺少 message 字段。", threadId, wide2Ascii(inputPath), i));
-            }
-            se.original_text = item.value("message", "");
-            sentences.push_back(se);
-        }
-        for (size_t i = 0; i < sentences.size(); ++i) {
-            if (i > 0) sentences[i].prev = &sentences[i - 1];
-            if (i + 1 < sentences.size()) sentences[i].next = &sentences[i + 1];
-        }
-        for (auto& se : sentences) {
-            preProcess(&se);
-        }
+    // 分片中的句子交给本线程，处理完即释放
+    std::vector<Sentence> sentences = std::move(partition.sentences);
+    for (size_t i = 0; i < sentences.size(); ++i) {
+        if (i > 0) sentences[i].prev = &sentences[i - 1];
+        if (i + 1 < sentences.size()) sentences[i].next = &sentences[i + 1];
     }
-    catch (const json::exception& e) {
-        throw std::runtime_error(std::format("[线程 {}] [文件 {}] 解析失败: {}", threadId, wide2Ascii(inputPath), e.what()));
+    for (auto& se : sentences) {
+        preProcess(&se);
     }
+    // 增量重建时记录每句命中的译后字典词条
+    std::vector<std::vector<uint64_t>> postDictHits(m_incrementalRebuild ? sentences.size() : 0);
+    auto postDictHitsOf = [&](const Sentence* se)
+        {
+            return postDictHits.empty() ? nullptr : &postDictHits[se - sentences.data()];
+        };
 
     if (m_transEngine == TransEngine::ShowNormal) {
-        json showNormalJson = json::array();
+        createParent(showNormalPath);
+        // gt_show_normal 是给人检查用的，和问题概览一样不压缩
+        JsonWriter writer(showNormalPath, 2);
+        writer.beginArray();
         for (const auto& se : sentences) {
-            json showNormalObj;
-            showNormalObj["name"] = se.name;
-            showNormalObj["original_text"] = se.original_text;
+            writer.beginObject();
+            writer.field("name", se.name);
+            writer.field("original_text", se.original_text);
             if (!se.other_info.empty()) {
-                showNormalObj["other_info"] = se.other_info;
+                writer.key("other_info");
+                writer.beginObject();
+                for (const auto& [k, v] : se.other_info) {
+                    writer.field(k, v);
+                }
+                writer.endObject();
             }
-            showNormalObj["pre_processed_text"] = se.pre_processed_text;
-            showNormalJson.push_back(showNormalObj);
+            writer.field("pre_processed_text", se.pre_processed_text);
+            writer.endObject();
             m_completedSentences++;
             m_controller->updateBar(); // ShowNormal
         }
-        createParent(showNormalPath);
-        std::ofstream ofs(showNormalPath);
-        ofs << showNormalJson.dump(2);
+        writer.endArray();
         return;
     }
 
     std::vector<Sentence*> toTranslate;
 
     {
-        std::map<std::string, json> cacheMap;
+        // 缓存文件按原样读入，cacheMap 中保存指向其中句子的指针
+        std::vector<std::vector<Sentence>> cacheLists;
+        std::unordered_map<std::string, const Sentence*> cacheMap;
 
-        auto insertCacheMap = [&cacheMap](const json& jsonArr)
+        auto insertCacheMap = [&cacheMap](const std::vector<const Sentence*>& cacheList)
             {
-                for (size_t i = 0; i < jsonArr.size(); ++i) {
-                    const auto& item = jsonArr[i];
+                auto keyPart = [](const Sentence* s) { return s->name + s->original_text + s->pre_processed_text; };
+                for (size_t i = 0; i < cacheList.size(); ++i) {
                     std::string prevText = "None", currentText, nextText = "None";
-                    currentText = item.value("name", "") + item.value("original_text", "") + item.value("pre_processed_text", "");
-                    if (i > 0) prevText = jsonArr[i - 1].value("name", "") + jsonArr[i - 1].value("original_text", "") + jsonArr[i - 1].value("pre_processed_text", "");
-                    if (i + 1 < jsonArr.size()) nextText = jsonArr[i + 1].value("name", "") + jsonArr[i + 1].value("original_text", "") + jsonArr[i + 1].value("pre_processed_text", "");
-                    cacheMap.insert(std::make_pair(prevText + currentText + nextText, item));
+                    currentText = keyPart(cacheList[i]);
+                    if (i > 0) prevText = keyPart(cacheList[i - 1]);
+                    if (i + 1 < cacheList.size()) nextText = keyPart(cacheList[i + 1]);
+                    cacheMap.emplace(prevText + currentText + nextText, cacheList[i]);
                 }
             };
 
@@ -792,7 +1150,7 @@ void NormalJsonTranslator::processFile(const fs::path& inputPath, int threadId)
             // 这个逻辑还挺耗时的
             size_t pos = relInputPath.filename().wstring().rfind(L"_part_");
             std::wstring orgStem = relInputPath.filename().wstring().substr(0, pos);
-            std::wstring cacheSpec = orgStem + L"_part_*.json";
+            std::wstring cacheSpec = orgStem + L"_part_*" + getCacheExtension();
             for (const auto& entry : fs::directory_iterator(m_cacheDir / relInputPath.parent_path())) {
                 if (!entry.is_regular_file()) {
                     continue;
@@ -801,69 +1159,90 @@ void NormalJsonTranslator::processFile(const fs::path& inputPath, int threadId)
                     cachePaths.push_back(entry.path());
                 }
             }
-
-            for (const auto& cp : cachePaths) {
-                std::lock_guard<std::mutex> lock(m_cacheMutex);
-                try {
-                    ifs.open(cp);
-                    json cacheJsonList = json::parse(ifs);
-                    ifs.close();
-                    m_logger->debug("[线程 {}] 从 {} 加载了 {} 条缓存记录。", threadId, wide2Ascii(cp), cacheMap.size());
-                    insertCacheMap(cacheJsonList);
-                }
-                catch (const json::exception& e) {
-                    throw std::runtime_error(std::format("[线程 {}] 缓存文件 {} 解析失败: {}", threadId, wide2Ascii(cp), e.what()));
-                }
-            }
         }
         else if (fs::exists(cachePath)) {
             cachePaths.push_back(cachePath);
         }
 
-        json totalCacheJsonList = json::array();
+        // 只有本分片自己的二进制缓存时直接用文件内的索引查找，不展开全部记录
+        std::optional<BinaryCache> binaryCache;
+        if (cachePaths.size() == 1 && cachePaths.front() == cachePath && m_cacheFormat == "binary") {
+            std::unique_lock<std::mutex> lock = lockSharedCache();
+            try {
+                binaryCache.emplace(cachePath, m_zstdCodec.get());
+            }
+            catch (const std::exception& e) {
+                throw std::runtime_error(std::format("[线程 {}] 缓存文件 {} 解析失败: {}", threadId, wide2Ascii(cachePath), e.what()));
+            }
+            m_logger->debug("[线程 {}] 从 {} 加载了 {} 条缓存记录。", threadId, wide2Ascii(cachePath), binaryCache->size());
+            cachePaths.clear();
+        }
+
         for (const auto& cp : cachePaths) {
-            std::lock_guard<std::mutex> lock(m_cacheMutex);
+            std::unique_lock<std::mutex> lock = lockSharedCache();
             try {
-                ifs.open(cp);
-                json cacheJsonList = json::parse(ifs);
-                ifs.close();
-                totalCacheJsonList.insert(totalCacheJsonList.end(), cacheJsonList.begin(), cacheJsonList.end());
-                m_logger->debug("[线程 {}] 从 {} 加载了 {} 条缓存记录。", threadId, wide2Ascii(cp), cacheMap.size());
+                cacheLists.push_back(readCacheFile(cp, m_zstdCodec.get()));
             }
-            catch (const json::exception& e) {
+            catch (const std::exception& e) {
                 throw std::runtime_error(std::format("[线程 {}] 缓存文件 {} 解析失败: {}", threadId, wide2Ascii(cp), e.what()));
             }
+            m_logger->debug("[线程 {}] 从 {} 加载了 {} 条缓存记录。", threadId, wide2Ascii(cp), cacheLists.back().size());
         }
-        insertCacheMap(totalCacheJsonList);
+
+        // 分割模式下先按单个缓存文件内的上下文插入，再按所有分片缓存拼接后的上下文插入
+        std::vector<const Sentence*> totalCacheList;
+        for (const auto& cacheList : cacheLists) {
+            std::vector<const Sentence*> cacheListPtrs;
+            for (const auto& cacheSe : cacheList) {
+                cacheListPtrs.push_back(&cacheSe);
+            }
+            if (m_needsCombining && m_transEngine != TransEngine::Rebuild) {
+                insertCacheMap(cacheListPtrs);
+            }
+            totalCacheList.insert(totalCacheList.end(), cacheListPtrs.begin(), cacheListPtrs.end());
+        }
+        insertCacheMap(totalCacheList);
 
 
         for (auto& se : sentences) {
             if (se.complete) {
                 m_completedSentences++;
                 m_controller->updateBar(); // 跳过已完成的句子
-                postProcess(&se);
+                postProcess(&se, postDictHitsOf(&se));
                 continue;
             }
             std::string key = generateCacheKey(&se);
-            auto it = cacheMap.find(key);
-            if (it == cacheMap.end()) {
+            const Sentence* cacheSe = nullptr;
+            Sentence binaryCacheSe;
+            if (binaryCache) {
+                if (auto recordIndex = binaryCache->find(key)) {
+                    binaryCacheSe = binaryCache->get(*recordIndex);
+                    cacheSe = &binaryCacheSe;
+                }
+            }
+            else if (auto it = cacheMap.find(key); it != cacheMap.end()) {
+                cacheSe = it->second;
+            }
+            if (!cacheSe) {
                 toTranslate.push_back(&se);
                 continue;
             }
-            const auto& item = it->second;
-            se.problem = item.value("problem", "");
+            se.problem = cacheSe->problem;
             if (m_transEngine != TransEngine::Rebuild && hasRetranslKey(m_retranslKeys, &se)) {
                 toTranslate.push_back(&se);
                 continue;
             }
-            se.pre_translated_text = item.value("pre_translated_text", "");
-            se.translated_by = item.value("translated_by", "");
+            se.pre_translated_text = cacheSe->pre_translated_text;
+            se.translated_by = cacheSe->translated_by;
             se.complete = true;
             m_completedSentences++;
             m_controller->updateBar(); // 命中缓存
-            postProcess(&se);
+            postProcess(&se, postDictHitsOf(&se));
         }
 
+        // 映射中的文件无法被覆盖写入，保存缓存前先解除映射
+        binaryCache.reset();
+
         m_logger->info("[线程 {}] [文件 {}] 共 {} 句，命中缓存 {} 句，需翻译 {} 句。", threadId, wide2Ascii(relInputPath),
             sentences.size(), sentences.size() - toTranslate.size(), toTranslate.size());
 
@@ -872,12 +1251,18 @@ void NormalJsonTranslator::processFile(const fs::path& inputPath, int threadId)
             for (auto& se : toTranslate) {
                 m_logger->error("[{}]", se->original_text);
             }
-            saveCache(sentences, cachePath);
+            saveCacheFile(sentences, cachePath);
             m_controller->reduceThreadNum();
             return;
         }
     }
 
+    if (m_transEngine == TransEngine::DryRun) {
+        estimateFile(relInputPath, sentences.size(), toTranslate);
+        m_controller->reduceThreadNum();
+        return;
+    }
+
     int batchCount = 0;
     for (size_t i = 0; i < toTranslate.size(); i += m_batchSize) {
         if (m_controller->shouldStop()) {
@@ -887,189 +1272,596 @@ void NormalJsonTranslator::processFile(const fs::path& inputPath, int threadId)
         std::vector<Sentence*> batch(toTranslate.begin() + i, toTranslate.begin() + std::min(i + m_batchSize, toTranslate.size()));
         translateBatchWithRetry(relInputPath, batch, threadId);
         for (auto& se : batch) {
-            postProcess(se);
+            postProcess(se, postDictHitsOf(se));
         }
         batchCount++;
         if (batchCount % m_saveCacheInterval == 0) {
-            m_logger->debug("[线程 {}] [文件 {}] 达到保存间隔，正在更新缓存文件...", threadId, wide2Ascii(inputPath));
-            std::lock_guard<std::mutex> lock(m_cacheMutex);
-            saveCache(sentences, cachePath);
+            m_logger->debug("[线程 {}] [文件 {}] 达到保存间隔，正在更新缓存文件...", threadId, wide2Ascii(relInputPath));
+            std::unique_lock<std::mutex> lock = lockSharedCache();
+            saveCacheFile(sentences, cachePath);
         }
     }
 
     {
-        std::lock_guard<std::mutex> lock(m_cacheMutex);
-        m_logger->debug("[线程 {}] [文件 {}] 翻译完成，正在进行最终保存...", threadId, wide2Ascii(inputPath));
-        saveCache(sentences, cachePath);
-        auto overviewArr = m_problemOverview["problemOverview"].as_array();
-        if (!overviewArr) {
-            throw std::runtime_error("problemOverview 字段不是数组");
-        }
-        std::string relInputPathStr = wide2Ascii(relInputPath);
-        for (const auto& se : sentences) {
-            if (se.problem.empty()) {
-                continue;
-            }
-            toml::table tbl;
-            tbl.insert("filename", relInputPathStr);
-            tbl.insert("index", se.index);
-            tbl.insert("name", se.name);
-            tbl.insert("name_preview", se.name_preview);
-            tbl.insert("original_text", se.original_text);
-            if (!se.other_info.empty()) {
-                toml::table otherInfoArr;
-                for (const auto& [k, v] : se.other_info) {
-                    otherInfoArr.insert(k, v);
-                }
-                tbl.insert("other_info", otherInfoArr);
-            }
-            tbl.insert("pre_processed_text", se.pre_processed_text);
-            tbl.insert("pre_translated_text", se.pre_translated_text);
-            tbl.insert("problem", se.problem);
-            tbl.insert("translated_by", se.translated_by);
-            tbl.insert("translated_preview", se.translated_preview);
-            overviewArr->push_back(tbl);
+        std::unique_lock<std::mutex> lock = lockSharedCache();
+        m_logger->debug("[线程 {}] [文件 {}] 翻译完成，正在进行最终保存...", threadId, wide2Ascii(relInputPath));
+        saveCacheFile(sentences, cachePath);
+    }
+    std::string relInputPathStr = wide2Ascii(relInputPath);
+    for (const auto& se : sentences) {
+        if (se.problem.empty()) {
+            continue;
         }
+        partition.problemEntries.push_back(makeProblemEntry(relInputPathStr, se));
     }
+    partition.postDictHits = std::move(postDictHits);
 
-    ordered_json outputJson = ordered_json::array();
-    for (const auto& se : sentences) {
-        ordered_json obj;
-        if (se.hasName) {
-            obj["name"] = se.name_preview;
+    if (!m_needsCombining) {
+        writeOutputJson(sentences, outputPath, m_outputWithSrc);
+        {
+            std::lock_guard<std::mutex> lock(m_rebuiltFilesMutex);
+            m_rebuiltFiles.insert(relInputPath);
         }
-        obj["message"] = se.translated_preview;
-        if (m_outputWithSrc) {
-            obj["src_msg"] = se.original_text;
+        m_logger->info("[线程 {}] [文件 {}] 处理完成。", threadId, wide2Ascii(relInputPath));
+        m_controller->reduceThreadNum();
+        if (m_onFileProcessed) {
+            m_onFileProcessed(relInputPath);
         }
-        outputJson.push_back(obj);
+        return;
     }
 
-    std::lock_guard<std::mutex> lock(m_outputCacheFileMutex);
-    std::ofstream ofs(outputPath);
-    ofs << outputJson.dump(2);
-    ofs.close();
-
     m_logger->info("[线程 {}] [文件 {}] 处理完成。", threadId, wide2Ascii(relInputPath));
     m_controller->reduceThreadNum();
 
-    if (m_needsCombining) {
-        fs::path originalRelFilePath = m_splitFilePartsToJson[relInputPath];
-        auto& splitFileParts = m_jsonToSplitFileParts[originalRelFilePath];
-        splitFileParts[relInputPath] = true;
-        if (
-            std::ranges::any_of(splitFileParts, [](const auto& p) { return !p.second; })
-            )
-        {
+    fs::path originalRelFilePath = partition.relWholePath;
+    // 最后一个分片把合并结果移出来，在锁外写出，免得其他文件的分片等待磁盘 I/O
+    std::vector<Sentence> mergedSentences;
+    {
+        std::lock_guard<std::mutex> lock(m_splitFileResultsMutex);
+        SplitFileResult& result = m_splitFileResults[originalRelFilePath];
+        auto mergedBegin = result.sentences.begin() + partition.offset;
+        std::ranges::move(sentences, mergedBegin);
+        // prev/next 还指向本分片即将销毁的 sentences，合并结果只用于写出，直接断开
+        for (auto it = mergedBegin; it != mergedBegin + sentences.size(); ++it) {
+            it->prev = nullptr;
+            it->next = nullptr;
+        }
+        if (--result.remainingParts > 0) {
             m_logger->debug("文件 {} 尚未全部处理完成，跳过合并。", wide2Ascii(relInputPath));
             return;
         }
-        m_logger->debug("开始合并 {} 的缓存文件...", wide2Ascii(relInputPath));
-        combineOutputFiles(originalRelFilePath, splitFileParts, m_logger, m_outputCacheDir, m_outputDir);
+        mergedSentences = std::move(result.sentences);
+        result.sentences = std::vector<Sentence>();
+    }
+    m_logger->debug("开始合并 {} 的所有分片...", wide2Ascii(originalRelFilePath));
+    writeOutputJson(mergedSentences, outputPath, m_outputWithSrc);
+    // 合并完即释放
+    mergedSentences = std::vector<Sentence>();
+    {
+        std::lock_guard<std::mutex> lock(m_rebuiltFilesMutex);
+        m_rebuiltFiles.insert(originalRelFilePath);
+    }
+    m_logger->info("文件 {} 合并完成，已保存到 {}", wide2Ascii(originalRelFilePath), wide2Ascii(outputPath));
 
-        if (m_onFileProcessed) {
-            m_onFileProcessed(originalRelFilePath);
-        }
+    if (m_onFileProcessed) {
+        m_onFileProcessed(originalRelFilePath);
+    }
+}
+
+// ============================================       缓存格式       ========================================
+void NormalJsonTranslator::saveCacheFile(const std::vector<Sentence>& allSentences, const fs::path& cachePath) {
+    if (m_cacheFormat == "binary") {
+        saveCacheBinary(allSentences, cachePath, getWriteCodec());
     }
     else {
-        if (m_onFileProcessed) {
-            m_onFileProcessed(relInputPath);
-        }
+        saveCache(allSentences, cachePath, getWriteCodec());
     }
 }
 
-// ================================================         run           ========================================
-void NormalJsonTranslator::run() {
-    m_logger->info("GalTransl++ NormalJsonTranlator 启动...");
+void NormalJsonTranslator::trainZstdDictionary() {
+    if (!m_zstdCompress || m_zstdCodec->hasDictionary()) {
+        return;
+    }
+    // 字典只训练一次，样本取自项目的输入文件和已有的未压缩缓存
+    std::vector<fs::path> samplePaths;
+    for (const auto& dir : { m_inputDir, m_cacheDir }) {
+        for (const auto& entry : fs::recursive_directory_iterator(dir)) {
+            if (entry.is_regular_file() && isSameExtension(entry.path(), L".json")) {
+                samplePaths.push_back(entry.path());
+            }
+        }
+    }
+    if (m_zstdCodec->trainDictionary(samplePaths)) {
+        m_logger->info("已根据项目文本训练 zstd 字典，请勿删除项目文件夹下的 zstd.dict，否则已压缩的文件将无法读取");
+    }
+    else {
+        m_logger->info("项目文本过少，暂不训练 zstd 字典，本次使用无字典压缩");
+    }
+}
 
-    for (const auto& dir : { m_inputDir, m_outputDir, m_cacheDir }) {
-        if (!fs::exists(dir)) {
-            fs::create_directories(dir);
-            m_logger->debug("已创建目录: {}", wide2Ascii(dir));
+void NormalJsonTranslator::migrateCacheFormat() {
+    // 另一种格式的缓存比当前格式的新(或当前格式不存在)时转换过来，旧文件保留，切回去时同样会被转换
+    std::wstring targetExt = getCacheExtension();
+    std::wstring sourceExt = m_cacheFormat == "binary" ? L".json" : L".gtc";
+    int convertedCount = 0;
+    for (const auto& entry : fs::recursive_directory_iterator(m_cacheDir)) {
+        if (!entry.is_regular_file() || !isSameExtension(entry.path(), sourceExt)) {
+            continue;
+        }
+        fs::path targetPath = entry.path();
+        targetPath.replace_extension(targetExt);
+        if (fs::exists(targetPath) && fs::last_write_time(targetPath) >= entry.last_write_time()) {
+            continue;
+        }
+        try {
+            convertCacheFile(entry.path(), targetPath, m_zstdCodec.get(), getWriteCodec());
+        }
+        catch (const std::exception& e) {
+            throw std::runtime_error(std::format("缓存文件 {} 转换失败: {}", wide2Ascii(entry.path()), e.what()));
         }
+        convertedCount++;
     }
+    if (convertedCount > 0) {
+        m_logger->info("已将 {} 个缓存文件转换为 {} 格式", convertedCount, m_cacheFormat);
+    }
+}
 
-    fs::remove_all(m_inputCacheDir);
-    fs::remove_all(m_outputCacheDir);
+// ============================================       增量重建       ========================================
+uint64_t hashFileContent(const fs::path& path, uint64_t hash) {
+    MappedFile mappedFile(path);
+    return fnv1a64(std::string_view(mappedFile.data(), mappedFile.size()), hash);
+}
 
-    std::ifstream ifs;
-    std::ofstream ofs;
+toml::table NormalJsonTranslator::makeProblemEntry(const std::string& filename, const Sentence& se) {
+    toml::table tbl;
+    tbl.insert("filename", filename);
+    tbl.insert("index", se.index);
+    tbl.insert("name", se.name);
+    tbl.insert("name_preview", se.name_preview);
+    tbl.insert("original_text", se.original_text);
+    if (!se.other_info.empty()) {
+        toml::table otherInfoArr;
+        for (const auto& [k, v] : se.other_info) {
+            otherInfoArr.insert(k, v);
+        }
+        tbl.insert("other_info", otherInfoArr);
+    }
+    tbl.insert("pre_processed_text", se.pre_processed_text);
+    tbl.insert("pre_translated_text", se.pre_translated_text);
+    tbl.insert("problem", se.problem);
+    tbl.insert("translated_by", se.translated_by);
+    tbl.insert("translated_preview", se.translated_preview);
+    return tbl;
+}
 
-    std::map<std::string, int> nameTableMap;
-    bool needGenerateNameTable = m_transEngine == TransEngine::DumpName || !fs::exists(m_projectDir / L"人名替换表.toml");
+uint64_t NormalJsonTranslator::computeRebuildGlobalHash() {
+    // 所有文件共用的输入: 重建相关的设置、字典、人名替换表和插件配置
+    uint64_t hash = m_rebuildConfigHash;
+    auto hashFile = [&](const fs::path& path)
+        {
+            hash = fnv1a64(wide2Ascii(path), hash);
+            if (fs::exists(path)) {
+                hash = hashFileContent(path, hash);
+            }
+        };
+    for (const auto& dictPath : m_dictPaths) {
+        hashFile(dictPath);
+    }
+    hashFile(m_projectDir / L"人名替换表.toml");
+    std::vector<fs::path> pluginConfigPaths;
+    if (fs::exists(pluginConfigsPath)) {
+        for (const auto& entry : fs::recursive_directory_iterator(pluginConfigsPath)) {
+            if (entry.is_regular_file() && isSameExtension(entry.path(), L".toml")) {
+                pluginConfigPaths.push_back(entry.path());
+            }
+        }
+    }
+    std::ranges::sort(pluginConfigPaths);
+    for (const auto& pluginConfigPath : pluginConfigPaths) {
+        hashFile(pluginConfigPath);
+    }
+    return hash;
+}
+
+std::optional<uint64_t> NormalJsonTranslator::computeRebuildFileHash(const fs::path& relWholePath, const std::vector<fs::path>& relPartPaths) {
+    fs::path outputPath = m_outputDir / relWholePath;
+    if (!fs::exists(outputPath)) {
+        return std::nullopt;
+    }
+    uint64_t hash = hashFileContent(m_inputDir / relWholePath, fnv1a64(wide2Ascii(relWholePath)));
+    for (const auto& relPartPath : relPartPaths) {
+        fs::path cachePath = m_cacheDir / relPartPath;
+        cachePath.replace_extension(getCacheExtension());
+        if (!fs::exists(cachePath)) {
+            return std::nullopt;
+        }
+        hash = hashFileContent(cachePath, fnv1a64(wide2Ascii(relPartPath), hash));
+    }
+    // 输出文件被改动过或者被删掉时也需要重建
+    return hashFileContent(outputPath, hash);
+}
 
-    Sentence se;
-    for (const auto& entry : fs::recursive_directory_iterator(m_inputDir)) {
-        if (!entry.is_regular_file() || !isSameExtension(entry.path(), L".json")) {
+std::set<fs::path> NormalJsonTranslator::skipUnchangedFiles(const json& manifest, uint64_t globalHash,
+    const std::map<fs::path, std::vector<fs::path>>& fileParts)
+{
+    std::set<fs::path> skippedFiles;
+    if (!manifest.is_object() || manifest.value("globalHash", "") != std::format("{:016x}", globalHash)) {
+        m_logger->info("字典、人名表、插件配置或相关设置有变化，将重建所有文件");
+        return skippedFiles;
+    }
+    auto filesIt = manifest.find("files");
+    if (filesIt == manifest.end() || !filesIt->is_object()) {
+        return skippedFiles;
+    }
+    for (const auto& [relWholePath, relPartPaths] : fileParts) {
+        auto it = filesIt->find(wide2Ascii(relWholePath));
+        if (it == filesIt->end() || !it->is_string()) {
             continue;
         }
-        try {
-            ifs.open(entry.path());
-            json data = json::parse(ifs);
-            ifs.close();
-            for (const auto& item : data) {
-                m_totalSentences++;
-                if (!needGenerateNameTable || !item.contains("name")) {
-                    continue;
-                }
-                se.name = item["name"].get<std::string>();
-                if (m_usePreDictInName) {
-                    se.name = m_preDictionary.doReplace(&se, CachePart::Name);
-                }
-                if (se.name.empty()) {
-                    continue;
-                }
-                auto it = nameTableMap.find(se.name);
-                if (it == nameTableMap.end()) {
-                    nameTableMap.insert(std::make_pair(se.name, 1));
+        auto fileHash = computeRebuildFileHash(relWholePath, relPartPaths);
+        if (fileHash && std::format("{:016x}", *fileHash) == it->get<std::string>()) {
+            skippedFiles.insert(relWholePath);
+        }
+    }
+
+    // 译后字典不参与全局哈希，而是和上次的词条比较，只重新处理受影响的句子
+    // 清单可能被手动改坏，其中的字段格式不对时和解析失败一样重建所有文件
+    auto parseFingerprint = [](const std::string& str) -> uint64_t
+        {
+            uint64_t fingerprint = 0;
+            auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), fingerprint, 16);
+            if (str.empty() || ec != std::errc() || ptr != str.data() + str.size()) {
+                throw std::invalid_argument("无效的词条指纹: " + str);
+            }
+            return fingerprint;
+        };
+    std::vector<uint64_t> oldEntries;
+    try {
+        if (auto hitsIt = manifest.find("postDictHits"); hitsIt != manifest.end() && hitsIt->is_object()) {
+            for (const auto& [fingerprintStr, files] : hitsIt->items()) {
+                uint64_t fingerprint = parseFingerprint(fingerprintStr);
+                for (const auto& [relFile, positions] : files.items()) {
+                    fs::path relWholePath = ascii2Wide(relFile);
+                    if (!skippedFiles.contains(relWholePath)) {
+                        continue;
+                    }
+                    for (const auto& position : positions) {
+                        m_postDictHits[fingerprint][relWholePath].insert(position.get<int>());
+                    }
                 }
-                else {
-                    it->second++;
+            }
+        }
+        if (auto entriesIt = manifest.find("postDictEntries"); entriesIt != manifest.end() && entriesIt->is_array()) {
+            for (const auto& fingerprintStr : *entriesIt) {
+                oldEntries.push_back(parseFingerprint(fingerprintStr.get_ref<const std::string&>()));
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        m_logger->warn("rebuild_manifest.json 中的译后字典记录无效，将重建所有文件: {}", e.what());
+        m_postDictHits.clear();
+        return {};
+    }
+    std::vector<uint64_t> newEntries = m_postDictionary.getFingerprints();
+    std::unordered_set<uint64_t> oldEntrySet(oldEntries.begin(), oldEntries.end());
+    std::unordered_set<uint64_t> newEntrySet(newEntries.begin(), newEntries.end());
+    std::unordered_set<uint64_t> removedEntries;
+    size_t addedCount = 0;
+    for (uint64_t fingerprint : oldEntries) {
+        if (!newEntrySet.contains(fingerprint)) {
+            removedEntries.insert(fingerprint);
+        }
+    }
+    for (uint64_t fingerprint : newEntries) {
+        if (!oldEntrySet.contains(fingerprint)) {
+            ++addedCount;
+        }
+    }
+    // 词条依次作用，保留下来的词条之间顺序变了(如同优先级的词条调换位置)，结果也可能不同
+    std::erase_if(oldEntries, [&](uint64_t fingerprint) { return !newEntrySet.contains(fingerprint); });
+    std::erase_if(newEntries, [&](uint64_t fingerprint) { return !oldEntrySet.contains(fingerprint); });
+    bool orderChanged = oldEntries != newEntries;
+    // 新增的词条可能只作用于链式替换中途产生的文本，删除的词条靠反向索引即可找到受影响的句子，
+    // 新增或调序时则要对跳过文件的每一句重新做译后处理，和缓存中的结果比较
+    bool recheckAll = addedCount > 0 || orderChanged;
+    if (!removedEntries.empty() || recheckAll) {
+        m_logger->info("译后字典有 {} 个词条被删除或修改，新增 {} 个词条{}，将只重新处理受影响的句子",
+            removedEntries.size(), addedCount, orderChanged ? "，词条顺序有变化" : "");
+    }
+
+    // 跳过的文件不再经过 ProblemAnalyzer，问题直接从它们的缓存中取回
+    auto overviewArr = m_problemOverview["problemOverview"].as_array();
+    if (!overviewArr) {
+        throw std::runtime_error("problemOverview 字段不是数组");
+    }
+    int skippedSentences = 0;
+    for (const auto& relWholePath : skippedFiles) {
+        const std::vector<fs::path>& relPartPaths = fileParts.at(relWholePath);
+        std::vector<std::vector<Sentence>> partCaches;
+        for (const auto& relPartPath : relPartPaths) {
+            fs::path cachePath = m_cacheDir / relPartPath;
+            cachePath.replace_extension(getCacheExtension());
+            partCaches.push_back(readCacheFile(cachePath, m_zstdCodec.get()));
+        }
+        if (!removedEntries.empty() || recheckAll) {
+            patchPostDictChanges(relWholePath, relPartPaths, partCaches, removedEntries, recheckAll);
+        }
+        for (size_t i = 0; i < relPartPaths.size(); ++i) {
+            std::string relPartPathStr = wide2Ascii(relPartPaths[i]);
+            for (const auto& se : partCaches[i]) {
+                if (!se.problem.empty()) {
+                    overviewArr->push_back(makeProblemEntry(relPartPathStr, se));
                 }
             }
         }
-        catch (const json::exception& e) {
-            m_logger->critical("读取文件 {} 时出错", wide2Ascii(entry.path()));
-            throw std::runtime_error(e.what());
+        m_splitFileResults.erase(relWholePath);
+    }
+    for (auto& partition : m_partitions) {
+        if (skippedFiles.contains(partition.relWholePath)) {
+            skippedSentences += (int)partition.sentences.size();
+            partition.sentences = std::vector<Sentence>();
         }
     }
+    m_completedSentences += skippedSentences;
+    m_controller->updateBar(skippedSentences);
+    if (!skippedFiles.empty()) {
+        m_logger->info("增量重建: {} 个文件及其缓存、输出均未变化，已跳过 {} 句", skippedFiles.size(), skippedSentences);
+    }
+    return skippedFiles;
+}
 
-    m_controller->makeBar(m_totalSentences, m_threadsNum);
+void NormalJsonTranslator::patchPostDictChanges(const fs::path& relWholePath, const std::vector<fs::path>& relPartPaths,
+    std::vector<std::vector<Sentence>>& partCaches, const std::unordered_set<uint64_t>& removedEntries, bool recheckAll)
+{
+    // 被删除或修改的词条从反向索引中找到命中过的句子，recheckAll 时所有句子都要重新处理
+    std::set<int> affectedPositions;
+    for (uint64_t fingerprint : removedEntries) {
+        auto it = m_postDictHits.find(fingerprint);
+        if (it == m_postDictHits.end()) {
+            continue;
+        }
+        auto fileIt = it->second.find(relWholePath);
+        if (fileIt != it->second.end()) {
+            affectedPositions.insert(fileIt->second.begin(), fileIt->second.end());
+        }
+    }
+    std::vector<std::pair<size_t, size_t>> positionToPart;
+    for (size_t p = 0; p < partCaches.size(); ++p) {
+        for (size_t i = 0; i < partCaches[p].size(); ++i) {
+            positionToPart.emplace_back(p, i);
+        }
+    }
+    if (recheckAll) {
+        for (size_t position = 0; position < positionToPart.size(); ++position) {
+            affectedPositions.insert((int)position);
+        }
+        // 每句的命中都会重新记录，先整体清掉本文件的旧记录
+        for (auto& [fingerprint, files] : m_postDictHits) {
+            files.erase(relWholePath);
+        }
+    }
+    if (affectedPositions.empty()) {
+        return;
+    }
 
-    if (needGenerateNameTable) {
-        std::vector<std::string> nameTableKeys;
-        for (const auto& [name, count] : nameTableMap) {
-            nameTableKeys.push_back(name);
+    fs::path outputPath = m_outputDir / relWholePath;
+    std::vector<Sentence> outputSentences = readOutputJson(outputPath);
+    if (outputSentences.size() != positionToPart.size()) {
+        throw std::runtime_error(std::format("[文件 {}] 输出与缓存的句子数不一致，请删除 rebuild_manifest.json 后重新 Rebuild", wide2Ascii(relWholePath)));
+    }
+
+    std::set<size_t> touchedParts;
+    int changedSentences = 0;
+    for (int position : affectedPositions) {
+        if (position < 0 || position >= (int)positionToPart.size()) {
+            continue;
+        }
+        auto [p, i] = positionToPart[position];
+        Sentence& cacheSe = partCaches[p][i];
+        // 从原文重新走一遍预处理以恢复换行符等信息，译文沿用缓存
+        Sentence se;
+        se.index = cacheSe.index;
+        se.hasName = outputSentences[position].hasName;
+        se.name = cacheSe.name;
+        se.original_text = cacheSe.original_text;
+        se.other_info = cacheSe.other_info;
+        preProcess(&se);
+        se.problem = cacheSe.problem;
+        se.pre_translated_text = cacheSe.pre_translated_text;
+        se.translated_by = cacheSe.translated_by;
+        se.complete = true;
+        std::vector<uint64_t> hits;
+        postProcess(&se, &hits);
+
+        if (!recheckAll) {
+            for (auto& [fingerprint, files] : m_postDictHits) {
+                if (auto fileIt = files.find(relWholePath); fileIt != files.end()) {
+                    fileIt->second.erase(position);
+                }
+            }
+        }
+        for (uint64_t fingerprint : hits) {
+            m_postDictHits[fingerprint][relWholePath].insert(position);
         }
-        std::ranges::sort(nameTableKeys, [&](const std::string& a, const std::string& b)
-            {
-                return nameTableMap[a] > nameTableMap[b];
-            });
 
-        ofs.open(m_projectDir / L"人名替换表.toml");
-        ofs << "# '原名' = [ '译名', 出现次数 ]" << std::endl;
-        for (const auto& key : nameTableKeys) {
-            auto nameTable = toml::table{ {key, toml::array{ "", nameTableMap[key] }} };
-            ofs << nameTable << std::endl;
-        }
-        ofs.close();
-        m_logger->info("已生成 人名替换表.toml 文件");
-        if (m_transEngine == TransEngine::DumpName) {
-            m_completedSentences += m_totalSentences;
-            m_controller->updateBar(m_totalSentences);
-            return;
+        if (se.name_preview == cacheSe.name_preview && se.translated_preview == cacheSe.translated_preview && se.problem == cacheSe.problem) {
+            continue;
         }
+        cacheSe.name_preview = se.name_preview;
+        cacheSe.translated_preview = se.translated_preview;
+        cacheSe.problem = se.problem;
+        outputSentences[position].name_preview = se.name_preview;
+        outputSentences[position].translated_preview = se.translated_preview;
+        touchedParts.insert(p);
+        ++changedSentences;
     }
 
-    if (m_transEngine == TransEngine::GenDict) {
-        DictionaryGenerator generator(m_controller, m_logger, m_apiPool, ascii2Wide(m_dictDir), m_systemPrompt, m_userPrompt, m_apiStrategy,
-            m_maxRetries, m_threadsNum, m_apiTimeOutMs, m_checkQuota);
-        fs::path outputFilePath = m_projectDir / L"项目GPT字典-生成.toml";
-        generator.generate(m_inputDir, outputFilePath, m_preDictionary, m_usePreDictInName);
-        m_logger->info("已生成 项目GPT字典-生成.toml 文件");
+    if (changedSentences == 0) {
         return;
     }
+    writeOutputJson(outputSentences, outputPath, m_outputWithSrc);
+    for (size_t p : touchedParts) {
+        fs::path cachePath = m_cacheDir / relPartPaths[p];
+        cachePath.replace_extension(getCacheExtension());
+        saveCacheFile(partCaches[p], cachePath);
+    }
+    m_rebuiltFiles.insert(relWholePath);
+    m_logger->info("[文件 {}] 译后字典的变化影响了 {} 句，已单独重新处理", wide2Ascii(relWholePath), changedSentences);
+}
 
+void NormalJsonTranslator::saveRebuildManifest(const json& oldManifest, uint64_t globalHash, const std::set<fs::path>& skippedFiles,
+    const std::map<fs::path, std::vector<fs::path>>& fileParts)
+{
+    json manifest;
+    manifest["globalHash"] = std::format("{:016x}", globalHash);
+    json& files = manifest["files"];
+    files = json::object();
+    for (const auto& relWholePath : skippedFiles) {
+        std::string key = wide2Ascii(relWholePath);
+        files[key] = oldManifest["files"][key];
+    }
+    // 只记录本次完整写出了输出的文件，有句子未命中缓存的文件下次仍会重建
+    for (const auto& relWholePath : m_rebuiltFiles) {
+        auto it = fileParts.find(relWholePath);
+        if (it == fileParts.end()) {
+            continue;
+        }
+        if (auto fileHash = computeRebuildFileHash(relWholePath, it->second)) {
+            files[wide2Ascii(relWholePath)] = std::format("{:016x}", *fileHash);
+        }
+    }
+
+    json& postDictEntries = manifest["postDictEntries"];
+    postDictEntries = json::array();
+    for (uint64_t fingerprint : m_postDictionary.getFingerprints()) {
+        postDictEntries.push_back(std::format("{:016x}", fingerprint));
+    }
+    json& postDictHits = manifest["postDictHits"];
+    postDictHits = json::object();
+    for (const auto& [fingerprint, hitFiles] : m_postDictHits) {
+        json hitFilesJson = json::object();
+        for (const auto& [relWholePath, positions] : hitFiles) {
+            std::string key = wide2Ascii(relWholePath);
+            if (positions.empty() || !files.contains(key)) {
+                continue;
+            }
+            hitFilesJson[key] = positions;
+        }
+        if (!hitFilesJson.empty()) {
+            postDictHits[std::format("{:016x}", fingerprint)] = hitFilesJson;
+        }
+    }
+
+    std::ofstream ofs(m_projectDir / L"rebuild_manifest.json");
+    ofs << manifest.dump(2);
+}
+
+std::vector<Sentence> NormalJsonTranslator::readInputFile(const fs::path& inputPath) {
+    try {
+        return readInputJson(inputPath);
+    }
+    catch (const std::exception& e) {
+        m_logger->critical("读取文件 {} 时出错", wide2Ascii(inputPath));
+        throw std::runtime_error(e.what());
+    }
+}
+
+void NormalJsonTranslator::countNames(const std::vector<Sentence>& sentences, std::map<std::string, int>& nameCounts) {
+    Sentence nameSe;
+    for (const auto& se : sentences) {
+        if (!se.hasName) {
+            continue;
+        }
+        nameSe.name = se.name;
+        if (m_usePreDictInName) {
+            nameSe.name = m_preDictionary.doReplace(&nameSe, CachePart::Name);
+        }
+        if (!nameSe.name.empty()) {
+            nameCounts[nameSe.name]++;
+        }
+    }
+}
+
+std::vector<size_t> NormalJsonTranslator::addInputPartitions(const fs::path& relWholePath, std::vector<Sentence>& fileSentences) {
+    std::vector<std::pair<size_t, size_t>> ranges;
+    if (!m_needsCombining) {
+        ranges.push_back(std::make_pair(0, fileSentences.size()));
+    }
+    else if (m_splitFile == "Equal") {
+        ranges = splitRangesEqual(fileSentences.size(), m_splitFileNum);
+    }
+    else {
+        ranges = splitRangesNum(fileSentences.size(), m_splitFileNum);
+    }
+
+    std::vector<size_t> partitionIndices;
+    std::wstring stem = relWholePath.parent_path() / relWholePath.stem();
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        InputPartition partition;
+        partition.relWholePath = relWholePath;
+        partition.offset = ranges[i].first;
+        partition.relPartPath = m_needsCombining ? fs::path(stem + L"_part_" + std::to_wstring(i) + relWholePath.extension().wstring()) : relWholePath;
+        partition.sentences.reserve(ranges[i].second - ranges[i].first);
+        for (size_t j = ranges[i].first; j < ranges[i].second; ++j) {
+            Sentence& se = fileSentences[j];
+            // 和单独的分割文件一样，每个分片内的序号都从 0 开始
+            se.index = (int)(j - ranges[i].first);
+            partition.textBytes += se.name.length() + se.original_text.length();
+            partition.sentences.push_back(std::move(se));
+        }
+        std::lock_guard<std::mutex> lock(m_partitionsMutex);
+        partitionIndices.push_back(m_partitions.size());
+        m_partitions.push_back(std::move(partition));
+    }
+    if (m_needsCombining) {
+        std::lock_guard<std::mutex> lock(m_splitFileResultsMutex);
+        SplitFileResult& result = m_splitFileResults[relWholePath];
+        result.sentences.resize(fileSentences.size());
+        result.remainingParts = (int)ranges.size();
+        m_logger->debug("文件 {} 已被分割成 {} 份。", wide2Ascii(relWholePath), ranges.size());
+    }
+    return partitionIndices;
+}
+
+void NormalJsonTranslator::sortPartitionOrder(std::vector<size_t>& partitionOrder) {
+    if (m_sortMethod == "size") {
+        std::ranges::stable_sort(partitionOrder, [&](size_t a, size_t b)
+            {
+                return m_partitions[a].textBytes > m_partitions[b].textBytes;
+            });
+    }
+    else if (m_sortMethod == "name") {
+        std::ranges::sort(partitionOrder, [&](size_t a, size_t b)
+            {
+                return m_partitions[a].relPartPath < m_partitions[b].relPartPath;
+            });
+    }
+    else {
+        throw std::invalid_argument(std::format("未知的排序模式: {}", m_sortMethod));
+    }
+}
+
+void NormalJsonTranslator::writeNameTable(std::map<std::string, int>& nameTableMap) {
+    std::vector<std::string> nameTableKeys;
+    for (const auto& [name, count] : nameTableMap) {
+        nameTableKeys.push_back(name);
+    }
+    std::ranges::sort(nameTableKeys, [&](const std::string& a, const std::string& b)
+        {
+            return nameTableMap[a] > nameTableMap[b];
+        });
+
+    std::ofstream ofs(m_projectDir / L"人名替换表.toml");
+    ofs << "# '原名' = [ '译名', 出现次数 ]" << std::endl;
+    for (const auto& key : nameTableKeys) {
+        auto nameTable = toml::table{ {key, toml::array{ "", nameTableMap[key] }} };
+        ofs << nameTable << std::endl;
+    }
+    m_logger->info("已生成 人名替换表.toml 文件");
+}
+
+void NormalJsonTranslator::loadNameTable() {
+    std::ifstream ifs;
     try {
         ifs.open(m_projectDir / L"人名替换表.toml");
         auto nameTable = toml::parse(ifs);
@@ -1091,155 +1883,287 @@ void NormalJsonTranslator::run() {
         m_logger->critical("解析 人名替换表.toml 时出错");
         throw std::runtime_error(e.what());
     }
+}
 
-    fs::path sourceDir = m_inputDir; // 默认从输入目录读取
-
-    if (m_splitFile == "Equal" && m_splitFileNum > 1) {
-        m_needsCombining = true;
-        sourceDir = m_inputCacheDir;
-        for (const auto& dir : { m_inputCacheDir, m_outputCacheDir }) {
-            if (!fs::exists(dir)) {
-                fs::create_directories(dir);
-                m_logger->info("已创建目录: {}", wide2Ascii(dir));
-            }
-        }
+std::vector<size_t> NormalJsonTranslator::translatePipelined(std::map<std::string, int>& nameTableMap, bool needGenerateNameTable) {
+    // 人名表要等全部输入到齐才能生成，新生成的表里也没有译名，不需要加载
+    if (!needGenerateNameTable) {
+        loadNameTable();
+    }
 
-        m_logger->info("检测到文件分割模式 (Equal)，开始预处理输入文件...");
-        for (const auto& entry : fs::recursive_directory_iterator(m_inputDir)) {
-            if (!entry.is_regular_file() || !isSameExtension(entry.path(), L".json")) {
-                continue;
-            }
+    ctpl::thread_pool pool(std::max(1, getWorkerThreadsNum()));
+    std::vector<std::future<void>> results;
+    std::vector<size_t> partitionOrder;
+    bool barCreated = false;
 
-            try {
-                ifs.open(entry.path());
-                json data = json::parse(ifs);
-                ifs.close();
-
-                std::vector<json> parts = splitJsonArrayEqual(data, m_splitFileNum);
-                fs::path relWholePath = fs::relative(entry.path(), m_inputDir); // 原始json相对路径
-
-                std::wstring stem = fs::relative(entry.path(), m_inputDir).parent_path() / entry.path().stem();
-                for (size_t i = 0; i < parts.size(); ++i) {
-                    fs::path relPartPath = stem + L"_part_" + std::to_wstring(i) + entry.path().extension().wstring();
-                    m_splitFilePartsToJson[relPartPath] = relWholePath;
-                    m_jsonToSplitFileParts[relWholePath].insert(std::make_pair(relPartPath, false));
-                    fs::path partPath = m_inputCacheDir / relPartPath;
-                    createParent(partPath);
-                    ofs.open(partPath);
-                    ofs << parts[i].dump(2);
-                    ofs.close();
+    // feed 在生产者所在的线程(即本线程)中调用，m_partitions 只在这里追加
+    auto feed = [&](const std::vector<fs::path>& relInputPaths)
+        {
+            std::vector<size_t> batchOrder;
+            int batchSentences = 0;
+            for (const auto& relInputPath : relInputPaths) {
+                std::vector<Sentence> fileSentences = readInputFile(m_inputDir / relInputPath);
+                batchSentences += (int)fileSentences.size();
+                if (needGenerateNameTable) {
+                    countNames(fileSentences, nameTableMap);
                 }
-                m_logger->debug("文件 {} 已被分割成 {} 份，存入输入缓存。", wide2Ascii(relWholePath), parts.size());
+                std::ranges::copy(addInputPartitions(relInputPath, fileSentences), std::back_inserter(batchOrder));
+            }
+            sortPartitionOrder(batchOrder);
 
+            m_totalSentences += batchSentences;
+            if (!barCreated && m_totalSentences > 0) {
+                m_controller->makeBar(m_totalSentences, getWorkerThreadsNum());
+                barCreated = true;
+            }
+            else if (barCreated && batchSentences > 0) {
+                m_controller->extendBar(batchSentences);
             }
-            catch (const json::exception& e) {
-                m_logger->critical("分割文件 {} 时出错", wide2Ascii(entry.path()));
-                throw std::runtime_error(e.what());
+
+            for (size_t partitionIndex : batchOrder) {
+                results.emplace_back(pool.push([=](int id)
+                    {
+                        this->processFile(partitionIndex, id);
+                    }));
+                partitionOrder.push_back(partitionIndex);
             }
+            m_logger->debug("已将 {} 个文件任务追加到线程池", batchOrder.size());
+        };
+
+    try {
+        m_inputProducer(feed);
+    }
+    catch (...) {
+        // 丢弃还没开始的任务，已经在运行的任务由线程池析构时等待
+        pool.clear_queue();
+        throw;
+    }
+
+    m_logger->info("输入已全部就绪，共 {} 个文件任务，等待处理完成...", results.size());
+    for (auto& result : results) {
+        result.get();
+    }
+
+    if (partitionOrder.empty()) {
+        throw std::runtime_error("未找到任何待翻译文件。");
+    }
+    if (needGenerateNameTable) {
+        writeNameTable(nameTableMap);
+    }
+    return partitionOrder;
+}
+
+// ================================================         run           ========================================
+void NormalJsonTranslator::run() {
+    m_logger->info("GalTransl++ NormalJsonTranlator 启动...");
+
+    for (const auto& dir : { m_inputDir, m_outputDir, m_cacheDir }) {
+        if (!fs::exists(dir)) {
+            fs::create_directories(dir);
+            m_logger->debug("已创建目录: {}", wide2Ascii(dir));
         }
     }
+
+    trainZstdDictionary();
+    migrateCacheFormat();
+
+    std::ifstream ifs;
+
+    if (m_splitFile == "Equal" && m_splitFileNum > 1) {
+        m_needsCombining = true;
+        m_logger->info("检测到文件分割模式 (Equal)，每个文件将被均分成 {} 份", m_splitFileNum);
+    }
     else if (m_splitFile == "Num" && m_splitFileNum > 0) {
         m_needsCombining = true;
-        sourceDir = m_inputCacheDir;
-        for (const auto& dir : { m_inputCacheDir, m_outputCacheDir }) {
-            if (!fs::exists(dir)) {
-                fs::create_directories(dir);
-                m_logger->info("已创建目录: {}", wide2Ascii(dir));
+        m_logger->info("检测到文件分割模式 (Num)，每个文件将按每 {} 句分割", m_splitFileNum);
+    }
+    else if (m_splitFile != "No") {
+        throw std::invalid_argument(std::format("未知的文件分割模式: {}, 请使用 'No', 'Equal', 'Num'", m_splitFile));
+    }
+
+    std::map<std::string, int> nameTableMap;
+    bool needGenerateNameTable = m_transEngine == TransEngine::DumpName || !fs::exists(m_projectDir / L"人名替换表.toml");
+    // 流水线模式只用于需要请求 API 的翻译，其余模式都要看到全部输入后才能开始
+    bool streamInputs = m_inputProducer && usesTranslationApi();
+    if (m_inputProducer && !streamInputs) {
+        m_inputProducer([](const std::vector<fs::path>&) {});
+    }
+
+    std::vector<size_t> partitionOrder;
+    json rebuildManifest;
+    uint64_t rebuildGlobalHash = 0;
+    std::set<fs::path> skippedFiles;
+    std::map<fs::path, std::vector<fs::path>> fileParts;
+    if (streamInputs) {
+        partitionOrder = translatePipelined(nameTableMap, needGenerateNameTable);
+    }
+    else {
+        // DumpName 和 GenDict 只需要统计，不需要保留句子
+        bool keepSentences = m_transEngine != TransEngine::DumpName && m_transEngine != TransEngine::GenDict;
+
+        // 每个输入文件只解析一次，统计句子数和人名的同时直接切成内存中的分片
+        // 解析和人名统计在 CPU 线程池中并行，分片仍按目录遍历的顺序建立
+        std::vector<fs::path> inputPaths;
+        for (const auto& entry : fs::recursive_directory_iterator(m_inputDir)) {
+            if (entry.is_regular_file() && isSameExtension(entry.path(), L".json")) {
+                inputPaths.push_back(entry.path());
             }
         }
+        struct InputFileResult {
+            std::vector<Sentence> sentences;
+            size_t sentenceCount = 0;
+            std::map<std::string, int> nameCounts;
+        };
+        ctpl::thread_pool inputPool(std::max(1, std::min((int)std::thread::hardware_concurrency(), (int)inputPaths.size())));
+        std::vector<std::future<InputFileResult>> inputResults;
+        for (const auto& inputPath : inputPaths) {
+            inputResults.emplace_back(inputPool.push([&, inputPath](int)
+                {
+                    InputFileResult result;
+                    result.sentences = readInputFile(inputPath);
+                    result.sentenceCount = result.sentences.size();
+                    if (needGenerateNameTable) {
+                        countNames(result.sentences, result.nameCounts);
+                    }
+                    if (!keepSentences) {
+                        result.sentences = std::vector<Sentence>();
+                    }
+                    return result;
+                }));
+        }
 
-        m_logger->info("检测到文件分割模式 (Num)，开始预处理输入文件...");
-        for (const auto& entry : fs::recursive_directory_iterator(m_inputDir)) {
-            if (!entry.is_regular_file() || !isSameExtension(entry.path(), L".json")) {
+        for (size_t f = 0; f < inputPaths.size(); ++f) {
+            InputFileResult inputResult = inputResults[f].get();
+            fs::path relWholePath = fs::relative(inputPaths[f], m_inputDir); // 原始json相对路径
+            m_totalSentences += (int)inputResult.sentenceCount;
+            for (const auto& [name, count] : inputResult.nameCounts) {
+                nameTableMap[name] += count;
+            }
+            if (!keepSentences) {
                 continue;
             }
+            addInputPartitions(relWholePath, inputResult.sentences);
+        }
 
-            try {
-                ifs.open(entry.path());
-                json data = json::parse(ifs);
-                ifs.close();
-
-                fs::path relWholePath = fs::relative(entry.path(), m_inputDir); // 原始json相对路径
-                std::vector<json> parts = splitJsonArrayNum(data, m_splitFileNum);
-
-                std::wstring stem = fs::relative(entry.path(), m_inputDir).parent_path() / entry.path().stem();
-                for (size_t i = 0; i < parts.size(); ++i) {
-                    fs::path relPartPath = stem + L"_part_" + std::to_wstring(i) + entry.path().extension().wstring();
-                    m_splitFilePartsToJson[relPartPath] = relWholePath;
-                    m_jsonToSplitFileParts[relWholePath].insert(std::make_pair(relPartPath, false));
-                    fs::path partPath = m_inputCacheDir / relPartPath;
-                    createParent(partPath);
-                    ofs.open(partPath);
-                    ofs << parts[i].dump(2);
-                    ofs.close();
-                }
-                m_logger->debug("文件 {} 已被按每 {} 句分割成 {} 份，存入输入缓存。",
-                    wide2Ascii(relWholePath), m_splitFileNum, parts.size());
+        m_controller->makeBar(m_totalSentences, getWorkerThreadsNum());
 
+        if (needGenerateNameTable) {
+            writeNameTable(nameTableMap);
+            if (m_transEngine == TransEngine::DumpName) {
+                m_completedSentences += m_totalSentences;
+                m_controller->updateBar(m_totalSentences);
+                return;
             }
-            catch (const std::exception& e) {
-                m_logger->critical("分割文件 {} 时出错", wide2Ascii(entry.path()));
-                throw std::runtime_error(e.what());
+        }
+
+        if (m_transEngine == TransEngine::GenDict) {
+            DictionaryGenerator generator(m_controller, m_logger, m_apiPool, m_usageStatistics, ascii2Wide(m_dictDir), m_systemPrompt, m_userPrompt, m_apiStrategy,
+                m_maxRetries, m_threadsNum, m_apiTimeOutMs, m_checkQuota);
+            fs::path outputFilePath = m_projectDir / L"项目GPT字典-生成.toml";
+            generator.generate(m_inputDir, outputFilePath, m_preDictionary, m_usePreDictInName);
+            m_logger->info("已生成 项目GPT字典-生成.toml 文件");
+            if (!m_usageStatistics.isEmpty()) {
+                m_usageStatistics.saveToFile(m_projectDir / L"翻译用量统计.json");
             }
+            return;
         }
-    }
-    else if (m_splitFile != "No") {
-        throw std::invalid_argument(std::format("未知的文件分割模式: {}, 请使用 'No', 'Equal', 'Num'", m_splitFile));
-    }
 
+        loadNameTable();
 
-    m_logger->debug("开始从目录 {} 分发翻译任务...", wide2Ascii(sourceDir));
-    std::vector<fs::path> filePaths;
-    for (const auto& entry : fs::recursive_directory_iterator(sourceDir)) {
-        if (entry.is_regular_file() && isSameExtension(entry.path(), L".json")) {
-            filePaths.push_back(entry.path());
+        if (m_partitions.empty()) {
+            throw std::runtime_error("未找到任何待翻译文件。");
         }
-    }
-    if (filePaths.empty()) {
-        throw std::runtime_error("未找到任何待翻译文件。");
-    }
 
-    if (m_sortMethod == "size") {
-        std::ranges::sort(filePaths, [](const fs::path& a, const fs::path& b)
+        if (m_transEngine == TransEngine::Rebuild && m_incrementalRebuild) {
+            fs::path rebuildManifestPath = m_projectDir / L"rebuild_manifest.json";
+            if (fs::exists(rebuildManifestPath)) {
+                try {
+                    ifs.open(rebuildManifestPath);
+                    rebuildManifest = json::parse(ifs);
+                    ifs.close();
+                }
+                catch (const json::exception& e) {
+                    ifs.close();
+                    m_logger->warn("解析 rebuild_manifest.json 时出错，将重建所有文件: {}", e.what());
+                    rebuildManifest = json();
+                }
+            }
+            for (const auto& partition : m_partitions) {
+                fileParts[partition.relWholePath].push_back(partition.relPartPath);
+            }
+            rebuildGlobalHash = computeRebuildGlobalHash();
+            skippedFiles = skipUnchangedFiles(rebuildManifest, rebuildGlobalHash, fileParts);
+            if (m_onFileProcessed) {
+                for (const auto& relWholePath : skippedFiles) {
+                    m_onFileProcessed(relWholePath);
+                }
+            }
+        }
+
+        partitionOrder.resize(m_partitions.size());
+        std::iota(partitionOrder.begin(), partitionOrder.end(), 0);
+        sortPartitionOrder(partitionOrder);
+        std::erase_if(partitionOrder, [&](size_t partitionIndex)
             {
-                return fs::file_size(a) > fs::file_size(b);
+                return skippedFiles.contains(m_partitions[partitionIndex].relWholePath);
             });
-    }
-    else if (m_sortMethod == "name") {
-        std::ranges::sort(filePaths);
-    }
-    else {
-        throw std::invalid_argument(std::format("未知的排序模式: {}", m_sortMethod));
-    }
 
 
-    ctpl::thread_pool pool(std::min(m_threadsNum, (int)filePaths.size()));
-    std::vector<std::future<void>> results;
+        ctpl::thread_pool pool(std::max(1, std::min(getWorkerThreadsNum(), (int)partitionOrder.size())));
+        std::vector<std::future<void>> results;
 
-    for (const auto& filePath : filePaths) {
-        results.emplace_back(pool.push([=](int id)
-            {
-                this->processFile(filePath, id);
-            }));
-    }
+        for (size_t partitionIndex : partitionOrder) {
+            results.emplace_back(pool.push([=](int id)
+                {
+                    this->processFile(partitionIndex, id);
+                }));
+        }
 
-    m_logger->info("已将 {} 个文件任务分配到线程池，等待处理完成...", results.size());
+        m_logger->info("已将 {} 个文件任务分配到线程池，等待处理完成...", results.size());
 
-    for (auto& result : results) {
-        result.get();
+        for (auto& result : results) {
+            result.get();
+        }
     }
 
+    // 按处理顺序汇总各分片的问题和字典命中
     auto overviewArr = m_problemOverview["problemOverview"].as_array();
     if (!overviewArr) {
         throw std::runtime_error("problemOverview 字段不是数组。");
     }
+    for (size_t partitionIndex : partitionOrder) {
+        InputPartition& partition = m_partitions[partitionIndex];
+        for (auto& problemEntry : partition.problemEntries) {
+            overviewArr->push_back(std::move(problemEntry));
+        }
+        for (size_t i = 0; i < partition.postDictHits.size(); ++i) {
+            for (uint64_t fingerprint : partition.postDictHits[i]) {
+                m_postDictHits[fingerprint][partition.relWholePath].insert((int)(partition.offset + i));
+            }
+        }
+    }
+
+    if (m_transEngine == TransEngine::Rebuild && m_incrementalRebuild) {
+        saveRebuildManifest(rebuildManifest, rebuildGlobalHash, skippedFiles, fileParts);
+    }
+
+    if (m_transEngine == TransEngine::DryRun) {
+        std::vector<fs::path> relInputPaths;
+        for (size_t partitionIndex : partitionOrder) {
+            relInputPaths.push_back(m_partitions[partitionIndex].relPartPath);
+        }
+        reportDryRun(relInputPaths);
+        return;
+    }
+
     if (overviewArr->empty()) {
         m_logger->info("\n\n```\n无问题概览\n```\n");
     }
     else {
-        ofs.open(m_projectDir / L"翻译问题概览.toml");
-        ofs << m_problemOverview;
-        ofs.close();
+        // 问题概览供人和 GUI 直接阅读，不受 zstdCompress 影响，始终以文本写出
+        std::ofstream overviewOfs(m_projectDir / L"翻译问题概览.toml");
+        overviewOfs << m_problemOverview;
+        overviewOfs.close();
         std::map<std::string, std::set<std::string>> problemMap;
         json problemOverviewJson = json::array();
         for (const auto& elem : *overviewArr) {
@@ -1255,9 +2179,9 @@ void NormalJsonTranslator::run() {
                 json::parse(ss.str())
             );
         }
-        ofs.open(m_projectDir / L"翻译问题概览.json");
-        ofs << problemOverviewJson.dump(2);
-        ofs.close();
+        overviewOfs.open(m_projectDir / L"翻译问题概览.json");
+        overviewOfs << problemOverviewJson.dump(2);
+        overviewOfs.close();
         m_logger->debug("已生成 翻译问题概览.json 和 翻译问题概览.toml 文件");
 
         std::string problemOverviewStr = "\n\n```\n问题概览:\n";
@@ -1286,8 +2210,10 @@ void NormalJsonTranslator::run() {
         m_logger->error("{}问题概览结束\n```\n", problemOverviewStr);
     }
 
-    fs::remove_all(m_inputCacheDir);
-    fs::remove_all(m_outputCacheDir);
+    if (!m_usageStatistics.isEmpty()) {
+        m_usageStatistics.saveToFile(m_projectDir / L"翻译用量统计.json");
+    }
+
     if (m_transEngine == TransEngine::Rebuild && m_completedSentences != m_totalSentences) {
         m_logger->critical("重建过程中有句子未命中缓存，请检查日志以定位问题。");
     }
@@ -0,0 +1,77 @@
+export module ResourceCache;
+
+import Tool;
+
+namespace fs = std::filesystem;
+
+export {
+
+    /**
+    * @brief 进程内的资源缓存，按类别和文件路径保存加载结果，文件内容的哈希变化时重新加载
+    * 常驻进程中连续的多次运行可以直接复用已解析好的字典等资源
+    */
+    class ResourceCache {
+    private:
+        struct CacheEntry {
+            uint64_t contentHash = 0;
+            std::shared_ptr<const void> resource;
+        };
+
+        std::mutex m_mutex;
+        std::map<std::pair<std::string, fs::path>, CacheEntry> m_entries;
+
+        ResourceCache() = default;
+
+    public:
+
+        static ResourceCache& instance() {
+            static ResourceCache cache;
+            return cache;
+        }
+
+        static uint64_t hashFile(const fs::path& path) {
+            std::ifstream ifs(path, std::ios::binary);
+            if (!ifs.is_open()) {
+                throw std::runtime_error(std::format("无法打开文件 {}", wide2Ascii(path)));
+            }
+            std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+            return fnv1a64(content);
+        }
+
+        /**
+        * @brief 取出 path 对应的资源，未缓存或文件内容已变化时调用 loader 重新加载
+        * 加载过程不持有锁，不同文件可以并行加载
+        */
+        template<typename Loader>
+        auto getOrLoad(const std::string& kind, const fs::path& path, Loader&& loader, bool* fromCache = nullptr)
+            -> std::shared_ptr<const std::invoke_result_t<Loader>> {
+            using T = std::invoke_result_t<Loader>;
+            auto key = std::make_pair(kind, fs::absolute(path).lexically_normal());
+            uint64_t contentHash = hashFile(path);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto it = m_entries.find(key);
+                if (it != m_entries.end() && it->second.contentHash == contentHash) {
+                    if (fromCache) {
+                        *fromCache = true;
+                    }
+                    return std::static_pointer_cast<const T>(it->second.resource);
+                }
+            }
+            auto resource = std::make_shared<const T>(loader());
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_entries[key] = CacheEntry{ contentHash, resource };
+            }
+            if (fromCache) {
+                *fromCache = false;
+            }
+            return resource;
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_entries.clear();
+        }
+    };
+}
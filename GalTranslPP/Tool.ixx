@@ -122,17 +122,26 @@ export {
         std::chrono::steady_clock::time_point lastReportTime;
         int reportCount = 0;
         bool stream = false;
+        // 流式请求是否带上 stream_options.include_usage 以获取用量，不支持该字段的后端(较旧的 llama.cpp、Sakura 等)需关闭
+        bool streamUsage = true;
     };
 
     enum  class TransEngine
     {
-        ForGalJson, ForGalTsv, ForNovelTsv, DeepseekJson, Sakura, DumpName, GenDict, Rebuild, ShowNormal
+        ForGalJson, ForGalTsv, ForNovelTsv, DeepseekJson, Sakura, DumpName, GenDict, Rebuild, ShowNormal, DryRun
     };
 
     struct ApiResponse {
         bool success = false;
         std::string content; // 成功时的内容 或 失败时的错误信息
         long statusCode = 0;   // HTTP 状态码
+
+        // 响应中 usage 字段给出的用量，流式请求需带上 stream_options.include_usage 才会返回
+        bool hasUsage = false;
+        int promptTokens = 0;
+        int completionTokens = 0;
+        int cachedTokens = 0;   // prompt 中命中服务端缓存的部分
+        double elapsedSeconds = 0.0; // 请求耗时
     };
 
     /**
@@ -156,6 +165,17 @@ export {
         return prev_text + current_text + next_text;
     }
 
+    /**
+    * @brief 64 位 FNV-1a 哈希，可以传入上一次的结果继续累加
+    */
+    uint64_t fnv1a64(std::string_view data, uint64_t hash = 14695981039346656037ull) {
+        for (unsigned char c : data) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
     /**
     * @brief 构建用于 Prompt 的上下文历史
     */
@@ -308,8 +328,24 @@ export {
         }
     }
 
+    // 粗略估算 token 数: ASCII 约 4 个字符一个 token，其余(假名/汉字等)约一个字符一个 token
+    int estimateTokens(const std::string& text) {
+        int asciiCount = 0;
+        int otherCount = 0;
+        for (unsigned char c : text) {
+            if (c < 0x80) {
+                asciiCount++;
+            }
+            else if ((c & 0xC0) != 0x80) {
+                // 只统计 UTF-8 的首字节
+                otherCount++;
+            }
+        }
+        return (asciiCount + 3) / 4 + otherCount;
+    }
+
     void parseContent(std::string& content, std::vector<Sentence*>& batchToTransThisRound, std::map<int, Sentence*>& id2SentenceMap, const std::string& modelName,
-        TransEngine transEngine, bool& parseError, int& parsedCount, std::shared_ptr<IController> controller, int& completedSentences) {
+        TransEngine transEngine, bool& parseError, int& parsedCount, std::shared_ptr<IController> controller, std::atomic<int>& completedSentences) {
         if (content.find("</think>") != std::string::npos) {
             content = content.substr(content.find("</think>") + 8);
         }
@@ -469,67 +505,102 @@ export {
         }
     }
 
-    void combineOutputFiles(const fs::path& originalRelFilePath, const std::map<fs::path, bool>& splitFileParts,
-        std::shared_ptr<spdlog::logger> logger, const fs::path& outputCacheDir, const fs::path& outputDir) {
+    /**
+    * @brief 从响应的 usage 字段中读取用量，兼容 OpenAI(prompt_tokens_details) 和 DeepSeek(prompt_cache_hit_tokens) 两种缓存字段
+    */
+    void parseUsage(const json& usage, ApiResponse& apiResponse) {
+        if (!usage.is_object()) {
+            return;
+        }
+        auto readInt = [&](const json& obj, const char* key) -> int
+            {
+                auto it = obj.find(key);
+                if (it == obj.end() || !it->is_number_integer()) {
+                    return 0;
+                }
+                return it->get<int>();
+            };
+        apiResponse.hasUsage = true;
+        apiResponse.promptTokens = readInt(usage, "prompt_tokens");
+        apiResponse.completionTokens = readInt(usage, "completion_tokens");
+        if (auto it = usage.find("prompt_tokens_details"); it != usage.end() && it->is_object()) {
+            apiResponse.cachedTokens = readInt(*it, "cached_tokens");
+        }
+        else {
+            apiResponse.cachedTokens = readInt(usage, "prompt_cache_hit_tokens");
+        }
+    }
 
-        ordered_json combinedJson = ordered_json::array();
+    /**
+    * @brief 进程内复用的 cpr::Session，同一地址的请求沿用已建立的连接，省去重复的 TCP/TLS 握手
+    * 流式和非流式请求的回调设置不同，分开存放
+    */
+    class ApiSessionPool {
+    private:
+        std::mutex m_mutex;
+        std::map<std::string, std::vector<std::unique_ptr<cpr::Session>>> m_idleSessions;
 
-        std::ifstream ifs;
-        logger->debug("开始合并文件: {}", wide2Ascii(originalRelFilePath));
+    public:
 
-        std::vector<fs::path> partPaths;
-        for (const auto& [relPartPath, ready] : splitFileParts) {
-            partPaths.push_back(relPartPath);
+        static ApiSessionPool& instance() {
+            static ApiSessionPool pool;
+            return pool;
         }
 
-        std::ranges::sort(partPaths, [&](const fs::path& a, const fs::path& b)
-            {
-                size_t posA = a.filename().wstring().rfind(L"_part_");
-                size_t posB = b.filename().wstring().rfind(L"_part_");
-                if (posA == std::wstring::npos || posB == std::wstring::npos) {
-                    return false;
-                }
-                std::wstring numA = a.filename().wstring().substr(posA + 6, a.filename().wstring().length() - posA - 11);
-                std::wstring numB = b.filename().wstring().substr(posB + 6, b.filename().wstring().length() - posB - 11);
-                return std::stoi(numA) < std::stoi(numB);
-            });
-
-        for (const auto& relPartPath : partPaths) {
-            fs::path partPath = outputCacheDir / relPartPath;
-            if (fs::exists(partPath)) {
-                try {
-                    ifs.open(partPath);
-                    ordered_json partData = ordered_json::parse(ifs);
-                    ifs.close();
-                    combinedJson.insert(combinedJson.end(), partData.begin(), partData.end());
-                }
-                catch (const json::exception& e) {
-                    ifs.close();
-                    logger->critical("合并文件 {} 时出错", wide2Ascii(partPath));
-                    throw std::runtime_error(e.what());
-                }
-            }
-            else {
-                throw std::runtime_error(std::format("试图合并 {} 时出错，缺少文件 {}", wide2Ascii(originalRelFilePath), wide2Ascii(partPath)));
+        std::unique_ptr<cpr::Session> acquire(const std::string& key) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto& sessions = m_idleSessions[key];
+            if (sessions.empty()) {
+                return std::make_unique<cpr::Session>();
             }
+            std::unique_ptr<cpr::Session> session = std::move(sessions.back());
+            sessions.pop_back();
+            return session;
         }
 
-        fs::path finalOutputPath = outputDir / originalRelFilePath;
-        createParent(finalOutputPath);
-        std::ofstream ofs(finalOutputPath);
-        ofs << combinedJson.dump(2);
-        logger->info("文件 {} 合并完成，已保存到 {}", wide2Ascii(originalRelFilePath), wide2Ascii(finalOutputPath));
-    }
+        void release(const std::string& key, std::unique_ptr<cpr::Session> session) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_idleSessions[key].push_back(std::move(session));
+        }
+    };
+
+    /**
+    * @brief 记录对 stream_options 返回 400 的接口地址，本进程内之后对这些地址的流式请求不再带上该字段
+    */
+    class StreamUsageBlocklist {
+    private:
+        std::mutex m_mutex;
+        std::set<std::string> m_urls;
+
+    public:
+
+        static StreamUsageBlocklist& instance() {
+            static StreamUsageBlocklist blocklist;
+            return blocklist;
+        }
+
+        bool contains(const std::string& url) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_urls.contains(url);
+        }
+
+        void add(const std::string& url) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_urls.insert(url);
+        }
+    };
 
     ApiResponse performApiRequest(json& payload, const TranslationAPI& api, int threadId,
         std::shared_ptr<IController> controller, std::shared_ptr<spdlog::logger> logger, int apiTimeOutMs) {
         ApiResponse apiResponse;
+        auto startTime = std::chrono::steady_clock::now();
 
         if (api.stream) {
             // =================================================
             // ===========   流式请求处理路径   ================
             // =================================================
             payload["stream"] = true;
+            bool withUsage = api.streamUsage && !StreamUsageBlocklist::instance().contains(api.apiurl);
             std::string concatenatedContent;
             std::string sseBuffer;
 
@@ -556,6 +627,10 @@ export {
                                         concatenatedContent += content_node.get<std::string>();
                                     }
                                 }
+                                // include_usage 时最后一个块的 choices 为空，只带 usage
+                                if (chunk.contains("usage")) {
+                                    parseUsage(chunk["usage"], apiResponse);
+                                }
                             }
                             catch (const json::exception&) {
 
@@ -569,15 +644,43 @@ export {
             // 2. 使用上面定义的 lambda 来构造一个 cpr::WriteCallback 类的实例
             cpr::WriteCallback writeCallbackInstance(callbackLambda);
 
-            // 3. 将该实例传递给 cpr::Post
-            cpr::Response response = cpr::Post(
-                cpr::Url{ api.apiurl },
-                cpr::Body{ payload.dump() },
-                cpr::Header{ {"Content-Type", "application/json"}, {"Authorization", "Bearer " + api.apikey} },
-                cpr::Timeout{ apiTimeOutMs },
-                writeCallbackInstance // 传递类的实例
-            );
+            // 3. 将该实例交给从连接池中取出的 Session
+            std::string sessionKey = api.apiurl + "#stream";
+            auto postStream = [&]() -> cpr::Response
+                {
+                    if (withUsage) {
+                        payload["stream_options"] = { {"include_usage", true} };
+                    }
+                    else {
+                        payload.erase("stream_options");
+                    }
+                    concatenatedContent.clear();
+                    sseBuffer.clear();
+                    std::unique_ptr<cpr::Session> session = ApiSessionPool::instance().acquire(sessionKey);
+                    session->SetUrl(cpr::Url{ api.apiurl });
+                    session->SetBody(cpr::Body{ payload.dump() });
+                    session->SetHeader(cpr::Header{ {"Content-Type", "application/json"}, {"Authorization", "Bearer " + api.apikey} });
+                    session->SetTimeout(cpr::Timeout{ apiTimeOutMs });
+                    session->SetWriteCallback(writeCallbackInstance);
+                    cpr::Response response = session->Post();
+                    ApiSessionPool::instance().release(sessionKey, std::move(session));
+                    return response;
+                };
+            cpr::Response response = postStream();
+            // 较旧的后端不认识 stream_options 会直接返回 400，去掉该字段重试一次，重试成功才记下这个地址
+            if (response.status_code == 400 && withUsage) {
+                withUsage = false;
+                // 耗时只算重试这一次，否则用量统计中该地址的输出速度会被低估
+                startTime = std::chrono::steady_clock::now();
+                response = postStream();
+                if (response.status_code == 200) {
+                    StreamUsageBlocklist::instance().add(api.apiurl);
+                    logger->warn("[线程 {}] {} 不支持 stream_options.include_usage，之后对该地址的流式请求不再带上此字段，也不会统计用量，"
+                        "可在该 API 的配置中设置 streamUsage = false", threadId, api.apiurl);
+                }
+            }
 
+            apiResponse.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
             apiResponse.statusCode = response.status_code;
             if (response.status_code == 200) {
                 apiResponse.success = true;
@@ -593,20 +696,26 @@ export {
             // =================================================
             // =========   非流式请求处理路径   =========
             // =================================================
-            cpr::Response response = cpr::Post(
-                cpr::Url{ api.apiurl },
-                cpr::Body{ payload.dump() },
-                cpr::Header{ {"Content-Type", "application/json"}, {"Authorization", "Bearer " + api.apikey} },
-                cpr::Timeout{ apiTimeOutMs }
-            );
-
+            std::unique_ptr<cpr::Session> session = ApiSessionPool::instance().acquire(api.apiurl);
+            session->SetUrl(cpr::Url{ api.apiurl });
+            session->SetBody(cpr::Body{ payload.dump() });
+            session->SetHeader(cpr::Header{ {"Content-Type", "application/json"}, {"Authorization", "Bearer " + api.apikey} });
+            session->SetTimeout(cpr::Timeout{ apiTimeOutMs });
+            cpr::Response response = session->Post();
+            ApiSessionPool::instance().release(api.apiurl, std::move(session));
+
+            apiResponse.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
             apiResponse.statusCode = response.status_code;
             apiResponse.content = response.text; // 先记录原始响应体
 
             if (response.status_code == 200) {
                 try {
                     // 解析完整的JSON响应
-                    apiResponse.content = json::parse(response.text)["choices"][0]["message"]["content"];
+                    json responseJson = json::parse(response.text);
+                    apiResponse.content = responseJson["choices"][0]["message"]["content"];
+                    if (responseJson.contains("usage")) {
+                        parseUsage(responseJson["usage"], apiResponse);
+                    }
                     apiResponse.success = true;
                 }
                 catch (const json::exception& e) {
@@ -682,73 +791,35 @@ export {
     }
 
     /**
-     * @brief 保存缓存，写入一个包含完整句子信息的 JSON 数组
-     */
-    void saveCache(const std::vector<Sentence>& allSentences, const fs::path& cachePath) {
-        json cacheJson = json::array();
-        for (const auto& se : allSentences) {
-            if (!se.complete) {
-                continue;
-            }
-            json cacheObj;
-            cacheObj["index"] = se.index;
-            cacheObj["name"] = se.name;
-            cacheObj["name_preview"] = se.name_preview;
-            cacheObj["original_text"] = se.original_text;
-            if (!se.other_info.empty()) {
-                cacheObj["other_info"] = se.other_info;
-            }
-            cacheObj["pre_processed_text"] = se.pre_processed_text;
-            cacheObj["pre_translated_text"] = se.pre_translated_text;
-            if (!se.problem.empty()) {
-                cacheObj["problem"] = se.problem;
-            }
-            cacheObj["translated_by"] = se.translated_by;
-            cacheObj["translated_preview"] = se.translated_preview;
-            cacheJson.push_back(cacheObj);
-        }
-        std::ofstream ofs(cachePath);
-        ofs << cacheJson.dump(2);
-    }
-
-    /**
-    * @brief 将一个大的 JSON 数组按指定的数量分割成多个小数组
-    * @param originalData 原始的 JSON 数组
-    * @param chunkSize 每个小数组包含的元素数量
-    * @return 一个包含多个小 JSON 数组的 vector
+    * @brief 将长度为 totalSize 的数组按指定的数量分割
+    * @param totalSize 原数组的长度
+    * @param chunkSize 每一份包含的元素数量
+    * @return 每一份在原数组中的 [起始, 结束) 范围
     */
-    std::vector<json> splitJsonArrayNum(const json& originalData, int chunkSize) {
-        if (chunkSize <= 0 || !originalData.is_array() || originalData.empty()) {
-            return { originalData };
+    std::vector<std::pair<size_t, size_t>> splitRangesNum(size_t totalSize, int chunkSize) {
+        if (chunkSize <= 0 || totalSize == 0) {
+            return { {0, totalSize} };
         }
 
-        std::vector<json> parts;
-        size_t totalSize = originalData.size();
-
+        std::vector<std::pair<size_t, size_t>> ranges;
         for (size_t i = 0; i < totalSize; i += chunkSize) {
-            size_t end = std::min(i + chunkSize, totalSize);
-            json part = json::array();
-            for (size_t j = i; j < end; ++j) {
-                part.push_back(originalData[j]);
-            }
-            parts.push_back(part);
+            ranges.push_back(std::make_pair(i, std::min(i + chunkSize, totalSize)));
         }
-        return parts;
+        return ranges;
     }
 
     /**
-     * @brief 将一个大的 JSON 数组分割成多个小数组
-     * @param originalData 原始的 JSON 数组
+     * @brief 将长度为 totalSize 的数组均分成多份
+     * @param totalSize 原数组的长度
      * @param numParts 要分割成的份数
-     * @return 一个包含多个小 JSON 数组的 vector
+     * @return 每一份在原数组中的 [起始, 结束) 范围
      */
-    std::vector<json> splitJsonArrayEqual(const json& originalData, int numParts) {
-        if (numParts <= 1 || !originalData.is_array() || originalData.empty()) {
-            return { originalData };
+    std::vector<std::pair<size_t, size_t>> splitRangesEqual(size_t totalSize, int numParts) {
+        if (numParts <= 1 || totalSize == 0) {
+            return { {0, totalSize} };
         }
 
-        std::vector<json> parts;
-        size_t totalSize = originalData.size();
+        std::vector<std::pair<size_t, size_t>> ranges;
         size_t partSize = totalSize / numParts;
         size_t remainder = totalSize % numParts;
         size_t currentIndex = 0;
@@ -757,14 +828,10 @@ export {
             size_t currentPartSize = partSize + (i < remainder ? 1 : 0);
             if (currentPartSize == 0) continue;
 
-            json part = json::array();
-            for (size_t j = 0; j < currentPartSize; ++j) {
-                part.push_back(originalData[currentIndex + j]);
-            }
-            parts.push_back(part);
+            ranges.push_back(std::make_pair(currentIndex, currentIndex + currentPartSize));
             currentIndex += currentPartSize;
         }
-        return parts;
+        return ranges;
     }
 
     bool isSameExtension(const fs::path& filePath, const std::wstring& ext) {
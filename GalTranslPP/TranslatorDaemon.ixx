@@ -0,0 +1,463 @@
+module;
+
+#include <Windows.h>
+#include <spdlog/spdlog.h>
+
+export module TranslatorDaemon;
+
+import <nlohmann/json.hpp>;
+import Tool;
+import ITranslator;
+import MeCabRegistry;
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+export {
+
+    std::wstring defaultDaemonPipeName = L"\\\\.\\pipe\\GalTranslPP";
+
+    /**
+    * @brief 常驻进程的服务端，在命名管道上接收任务并在本进程内运行翻译器
+    * 字典、API 连接等资源在进程内缓存，连续的多次运行不必重新加载
+    * 每个连接在单独的线程中处理，收到退出请求后通知正在运行的任务停止，等所有连接结束后返回
+    */
+    void runTranslatorDaemon(const std::wstring& pipeName, std::shared_ptr<spdlog::logger> logger);
+
+    /**
+    * @brief 请求常驻进程退出，正在运行的任务会像用户点了停止一样尽快结束
+    * @return 常驻进程不存在时返回 false
+    */
+    bool stopDaemon(const std::wstring& pipeName);
+
+    /**
+    * @brief 把项目提交给常驻进程运行，进度和日志通过 controller 转发回来
+    * @return 常驻进程不存在时返回 false，调用方可以改为在本进程内运行
+    * 任务失败时抛出与本地运行时相同类型的异常
+    */
+    bool submitToDaemon(const std::wstring& pipeName, const fs::path& projectDir, std::shared_ptr<IController> controller);
+}
+
+
+module :private;
+
+/**
+* @brief 管道上的消息为逐行的 UTF-8 JSON
+* 读写都在同一把锁下进行，且读取只取已经到达的数据，同步句柄上不会出现读写互相阻塞
+*/
+class PipeConnection {
+private:
+    HANDLE m_pipe;
+    bool m_isServer;
+    std::mutex m_ioMutex;
+    std::string m_readBuffer;
+
+    std::optional<json> takeLine() {
+        size_t pos = m_readBuffer.find('\n');
+        if (pos == std::string::npos) {
+            return std::nullopt;
+        }
+        std::string line = m_readBuffer.substr(0, pos);
+        m_readBuffer.erase(0, pos + 1);
+        return json::parse(line);
+    }
+
+public:
+    PipeConnection(HANDLE pipe, bool isServer) : m_pipe(pipe), m_isServer(isServer) {}
+
+    ~PipeConnection() {
+        if (m_isServer) {
+            FlushFileBuffers(m_pipe);
+            DisconnectNamedPipe(m_pipe);
+        }
+        CloseHandle(m_pipe);
+    }
+
+    PipeConnection(const PipeConnection&) = delete;
+    PipeConnection& operator=(const PipeConnection&) = delete;
+
+    bool writeMessage(const json& message) {
+        std::string line = message.dump() + "\n";
+        std::lock_guard<std::mutex> lock(m_ioMutex);
+        DWORD written = 0;
+        return WriteFile(m_pipe, line.data(), (DWORD)line.size(), &written, nullptr) && written == line.size();
+    }
+
+    /**
+    * @brief 取出一条已经完整到达的消息，没有时立即返回 nullopt，连接断开时抛出异常
+    */
+    std::optional<json> tryReadMessage() {
+        std::lock_guard<std::mutex> lock(m_ioMutex);
+        if (auto message = takeLine()) {
+            return message;
+        }
+        DWORD available = 0;
+        if (!PeekNamedPipe(m_pipe, nullptr, 0, nullptr, &available, nullptr)) {
+            throw std::runtime_error("命名管道连接已断开");
+        }
+        if (available == 0) {
+            return std::nullopt;
+        }
+        std::string chunk(available, '\0');
+        DWORD read = 0;
+        if (!ReadFile(m_pipe, chunk.data(), available, &read, nullptr)) {
+            throw std::runtime_error("命名管道连接已断开");
+        }
+        m_readBuffer.append(chunk.data(), read);
+        return takeLine();
+    }
+
+    /**
+    * @brief 阻塞读取一条消息，只在没有其它线程使用该连接时调用
+    */
+    std::optional<json> readMessage() {
+        std::lock_guard<std::mutex> lock(m_ioMutex);
+        char chunk[4096];
+        while (true) {
+            if (auto message = takeLine()) {
+                return message;
+            }
+            DWORD read = 0;
+            if (!ReadFile(m_pipe, chunk, sizeof(chunk), &read, nullptr) || read == 0) {
+                return std::nullopt;
+            }
+            m_readBuffer.append(chunk, read);
+        }
+    }
+};
+
+// 收到退出请求后置位，所有正在运行的任务都会看到停止请求
+std::atomic<bool> g_daemonShuttingDown = false;
+
+/**
+* @brief 常驻进程一侧的 IController，把所有调用转成消息发回客户端
+* 管道的读取和进度的发送都放在后台线程中，翻译线程调用 shouldStop 和 updateBar 时只访问原子变量
+*/
+class PipeController : public IController {
+private:
+    std::shared_ptr<PipeConnection> m_connection;
+    std::atomic<bool> m_stopRequested = false;
+    // 进度增量先累加，由后台线程定时合并成一条消息发出，而不是每句一条
+    std::atomic<int> m_pendingTicks = 0;
+
+    std::mutex m_closeMutex;
+    std::condition_variable m_closeCv;
+    bool m_closed = false;
+    std::thread m_pumpThread;
+
+    void send(const json& message) {
+        if (!m_connection->writeMessage(message)) {
+            // 客户端已经断开，没有必要继续运行
+            m_stopRequested = true;
+        }
+    }
+
+    void flushTicks() {
+        if (int ticks = m_pendingTicks.exchange(0); ticks != 0) {
+            send({ {"type", "updateBar"}, {"ticks", ticks} });
+        }
+    }
+
+    void pollStopMessages() {
+        try {
+            while (auto message = m_connection->tryReadMessage()) {
+                if ((*message)["type"] == "stop") {
+                    m_stopRequested = true;
+                }
+            }
+        }
+        catch (const std::exception&) {
+            m_stopRequested = true;
+        }
+    }
+
+    void pump() {
+        std::unique_lock<std::mutex> lock(m_closeMutex);
+        while (!m_closed) {
+            m_closeCv.wait_for(lock, std::chrono::milliseconds(50));
+            lock.unlock();
+            flushTicks();
+            pollStopMessages();
+            lock.lock();
+        }
+    }
+
+public:
+    explicit PipeController(std::shared_ptr<PipeConnection> connection) : m_connection(connection) {
+        m_pumpThread = std::thread([this]()
+            {
+                pump();
+            });
+    }
+
+    ~PipeController() {
+        close();
+    }
+
+    /**
+    * @brief 停止后台线程并发出还没发送的进度，在向客户端发送最终结果之前调用
+    */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_closeMutex);
+            if (m_closed) {
+                return;
+            }
+            m_closed = true;
+        }
+        m_closeCv.notify_all();
+        m_pumpThread.join();
+        flushTicks();
+    }
+
+    virtual void makeBar(int totalSentences, int totalThreads) override {
+        send({ {"type", "makeBar"}, {"totalSentences", totalSentences}, {"totalThreads", totalThreads} });
+    }
+
+    virtual void extendBar(int moreSentences) override {
+        send({ {"type", "extendBar"}, {"moreSentences", moreSentences} });
+    }
+
+    virtual void writeLog(const std::string& log) override {
+        send({ {"type", "log"}, {"text", log} });
+    }
+
+    virtual void addThreadNum() override {
+        send({ {"type", "addThread"} });
+    }
+
+    virtual void reduceThreadNum() override {
+        send({ {"type", "reduceThread"} });
+    }
+
+    virtual void updateBar(int ticks) override {
+        m_pendingTicks += ticks;
+    }
+
+    virtual bool shouldStop() override {
+        return m_stopRequested || g_daemonShuttingDown;
+    }
+};
+
+std::mutex g_runningProjectsMutex;
+std::set<fs::path> g_runningProjects;
+
+/**
+* @brief 连接到常驻进程的管道，常驻进程不存在时返回 INVALID_HANDLE_VALUE
+*/
+HANDLE connectToDaemon(const std::wstring& pipeName) {
+    while (true) {
+        HANDLE pipe = CreateFileW(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+        if (pipe != INVALID_HANDLE_VALUE) {
+            return pipe;
+        }
+        // 常驻进程在接受一个连接后才会创建下一个管道实例，短暂的忙碌只需等待
+        if (GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipeW(pipeName.c_str(), 5000)) {
+            return INVALID_HANDLE_VALUE;
+        }
+    }
+}
+
+void serveClient(std::shared_ptr<PipeConnection> connection, const std::wstring& pipeName, std::shared_ptr<spdlog::logger> logger) {
+    // 不能阻塞读取，否则连上后一直不发请求的客户端会让线程永远挂起，退出时也就无法 join
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    std::optional<json> request;
+    try {
+        while (!(request = connection->tryReadMessage())) {
+            if (g_daemonShuttingDown) {
+                return;
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                logger->warn("客户端连接后超时未发送请求，已断开");
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    catch (const json::exception& e) {
+        logger->error("无法解析客户端请求: {}", e.what());
+        return;
+    }
+    catch (const std::runtime_error&) {
+        // 客户端在发送请求前就断开了
+        return;
+    }
+    if (request && request->value("type", "") == "shutdown") {
+        logger->info("收到退出请求，等待正在运行的任务停止");
+        g_daemonShuttingDown = true;
+        connection->writeMessage({ {"type", "done"} });
+        // 接受连接的循环阻塞在 ConnectNamedPipe 上，连一次管道把它唤醒
+        if (HANDLE pipe = connectToDaemon(pipeName); pipe != INVALID_HANDLE_VALUE) {
+            CloseHandle(pipe);
+        }
+        return;
+    }
+    if (!request || request->value("type", "") != "run") {
+        logger->error("客户端请求无效");
+        return;
+    }
+
+    fs::path projectDir = ascii2Wide(request->value("projectDir", ""));
+    fs::path projectKey = fs::absolute(projectDir).lexically_normal();
+    {
+        std::lock_guard<std::mutex> lock(g_runningProjectsMutex);
+        if (!g_runningProjects.insert(projectKey).second) {
+            connection->writeMessage({ {"type", "error"}, {"kind", "runtime_error"},
+                {"message", std::format("项目 {} 正在常驻进程中运行", wide2Ascii(projectDir))} });
+            return;
+        }
+    }
+    logger->info("开始处理项目: {}", wide2Ascii(projectDir));
+
+    json result = { {"type", "done"} };
+    auto controller = std::make_shared<PipeController>(connection);
+    try {
+        std::unique_ptr<ITranslator> translator = createTranslator(projectDir, controller);
+        if (!translator) {
+            throw std::runtime_error("创建翻译器实例失败，请检查项目配置。");
+        }
+        translator->run();
+    }
+    catch (const std::invalid_argument& e) {
+        result = { {"type", "error"}, {"kind", "invalid_argument"}, {"message", e.what()} };
+    }
+    catch (const std::exception& e) {
+        result = { {"type", "error"}, {"kind", "runtime_error"}, {"message", e.what()} };
+    }
+    {
+        std::lock_guard<std::mutex> lock(g_runningProjectsMutex);
+        g_runningProjects.erase(projectKey);
+    }
+    controller->close();
+    if (result["type"] == "error") {
+        logger->error("项目 {} 处理失败: {}", wide2Ascii(projectDir), result["message"].get<std::string>());
+    }
+    else {
+        logger->info("项目 {} 处理完成", wide2Ascii(projectDir));
+    }
+    connection->writeMessage(result);
+}
+
+void runTranslatorDaemon(const std::wstring& pipeName, std::shared_ptr<spdlog::logger> logger) {
+    logger->info("常驻进程已启动，管道: {}", wide2Ascii(pipeName));
+    MeCabRegistry::instance().setKeepLoaded(true);
+
+    // 每个连接一个线程，结束的线程在接受下一个连接时回收，退出时等待全部结束
+    struct ClientThread {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> finished;
+    };
+    std::list<ClientThread> clientThreads;
+    auto joinFinishedClients = [&](bool all)
+        {
+            for (auto it = clientThreads.begin(); it != clientThreads.end();) {
+                if (all || *it->finished) {
+                    it->thread.join();
+                    it = clientThreads.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        };
+
+    while (!g_daemonShuttingDown) {
+        HANDLE pipe = CreateNamedPipeW(pipeName.c_str(), PIPE_ACCESS_DUPLEX,
+            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            PIPE_UNLIMITED_INSTANCES, 1 << 16, 1 << 16, 0, nullptr);
+        if (pipe == INVALID_HANDLE_VALUE) {
+            g_daemonShuttingDown = true;
+            joinFinishedClients(true);
+            throw std::runtime_error(std::format("无法创建命名管道 {}，错误码: {}", wide2Ascii(pipeName), GetLastError()));
+        }
+        if (!ConnectNamedPipe(pipe, nullptr) && GetLastError() != ERROR_PIPE_CONNECTED) {
+            CloseHandle(pipe);
+            continue;
+        }
+        auto connection = std::make_shared<PipeConnection>(pipe, true);
+        if (g_daemonShuttingDown) {
+            // 这是退出请求用来唤醒本循环的连接
+            break;
+        }
+        joinFinishedClients(false);
+        auto finished = std::make_shared<std::atomic<bool>>(false);
+        clientThreads.push_back({ std::thread([connection, pipeName, logger, finished]()
+            {
+                serveClient(connection, pipeName, logger);
+                *finished = true;
+            }), finished });
+    }
+
+    joinFinishedClients(true);
+    MeCabRegistry::instance().setKeepLoaded(false);
+    logger->info("常驻进程已退出");
+}
+
+bool stopDaemon(const std::wstring& pipeName) {
+    HANDLE pipe = connectToDaemon(pipeName);
+    if (pipe == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    PipeConnection connection(pipe, false);
+    if (!connection.writeMessage({ {"type", "shutdown"} })) {
+        return false;
+    }
+    connection.readMessage();
+    return true;
+}
+
+bool submitToDaemon(const std::wstring& pipeName, const fs::path& projectDir, std::shared_ptr<IController> controller) {
+    HANDLE pipe = connectToDaemon(pipeName);
+    if (pipe == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    PipeConnection connection(pipe, false);
+    // 常驻进程的工作目录和客户端不同，相对路径要在这里解析
+    fs::path absoluteProjectDir = fs::absolute(projectDir).lexically_normal();
+    if (!connection.writeMessage({ {"type", "run"}, {"projectDir", wide2Ascii(absoluteProjectDir)} })) {
+        return false;
+    }
+
+    bool stopSent = false;
+    while (true) {
+        std::optional<json> message = connection.tryReadMessage();
+        if (!message) {
+            if (!stopSent && controller->shouldStop()) {
+                connection.writeMessage({ {"type", "stop"} });
+                stopSent = true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            continue;
+        }
+
+        const std::string type = (*message)["type"];
+        if (type == "makeBar") {
+            controller->makeBar((*message)["totalSentences"], (*message)["totalThreads"]);
+        }
+        else if (type == "extendBar") {
+            controller->extendBar((*message)["moreSentences"]);
+        }
+        else if (type == "log") {
+            controller->writeLog((*message)["text"]);
+        }
+        else if (type == "addThread") {
+            controller->addThreadNum();
+        }
+        else if (type == "reduceThread") {
+            controller->reduceThreadNum();
+        }
+        else if (type == "updateBar") {
+            controller->updateBar((*message)["ticks"]);
+        }
+        else if (type == "done") {
+            return true;
+        }
+        else if (type == "error") {
+            std::string errorMessage = (*message)["message"];
+            if ((*message)["kind"] == "invalid_argument") {
+                throw std::invalid_argument(errorMessage);
+            }
+            throw std::runtime_error(errorMessage);
+        }
+    }
+}
@@ -0,0 +1,136 @@
+module;
+
+#include <spdlog/spdlog.h>
+
+export module UsageStatistics;
+
+import <nlohmann/json.hpp>;
+import Tool;
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+export {
+
+    struct UsageCounter {
+        int requests = 0;
+        int failedRequests = 0;
+        long long promptTokens = 0;
+        long long completionTokens = 0;
+        long long cachedTokens = 0;
+        double seconds = 0.0;
+    };
+
+    /**
+    * @brief 统计 API 用量，按 API Key、文件、重试原因和请求端点分别汇总
+    */
+    class UsageStatistics {
+    private:
+        UsageCounter m_total;
+        std::map<std::string, UsageCounter> m_byApiKey;
+        std::map<std::string, UsageCounter> m_byFile;
+        std::map<std::string, UsageCounter> m_byRetryReason;
+        std::map<std::string, UsageCounter> m_byEndpoint;
+
+        std::shared_ptr<spdlog::logger> m_logger;
+        std::mutex m_mutex;
+
+    public:
+        UsageStatistics(std::shared_ptr<spdlog::logger> logger) : m_logger(logger) {}
+
+        void record(const TranslationAPI& api, const std::string& file, const std::string& retryReason, const ApiResponse& response);
+
+        bool isEmpty();
+
+        void saveToFile(const fs::path& filePath);
+    };
+}
+
+
+module :private;
+
+void addToCounter(UsageCounter& counter, const ApiResponse& response) {
+    counter.requests++;
+    if (!response.success) {
+        counter.failedRequests++;
+    }
+    counter.promptTokens += response.promptTokens;
+    counter.completionTokens += response.completionTokens;
+    counter.cachedTokens += response.cachedTokens;
+    counter.seconds += response.elapsedSeconds;
+}
+
+json counterToJson(const UsageCounter& counter) {
+    return {
+        {"requests", counter.requests},
+        {"failedRequests", counter.failedRequests},
+        {"promptTokens", counter.promptTokens},
+        {"completionTokens", counter.completionTokens},
+        {"cachedTokens", counter.cachedTokens},
+        {"totalTokens", counter.promptTokens + counter.completionTokens},
+        {"seconds", counter.seconds},
+    };
+}
+
+// 不把完整的 key 写进统计文件
+std::string maskApiKey(const std::string& apikey) {
+    if (apikey.length() <= 10) {
+        return apikey;
+    }
+    return apikey.substr(0, 6) + "..." + apikey.substr(apikey.length() - 4);
+}
+
+void UsageStatistics::record(const TranslationAPI& api, const std::string& file, const std::string& retryReason, const ApiResponse& response) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    addToCounter(m_total, response);
+    addToCounter(m_byApiKey[maskApiKey(api.apikey)], response);
+    addToCounter(m_byFile[file], response);
+    addToCounter(m_byRetryReason[retryReason], response);
+    addToCounter(m_byEndpoint[api.apiurl + " | " + api.modelName], response);
+    if (response.success && !response.hasUsage) {
+        m_logger->trace("API [{}] 的响应中没有 usage 字段", api.apiurl);
+    }
+}
+
+bool UsageStatistics::isEmpty() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_total.requests == 0;
+}
+
+void UsageStatistics::saveToFile(const fs::path& filePath) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto mapToJson = [](const std::map<std::string, UsageCounter>& counters)
+        {
+            json obj = json::object();
+            for (const auto& [key, counter] : counters) {
+                obj[key] = counterToJson(counter);
+            }
+            return obj;
+        };
+
+    json endpointsJson = json::object();
+    for (const auto& [endpoint, counter] : m_byEndpoint) {
+        json obj = counterToJson(counter);
+        // 吞吐量按所有请求(包括失败的)的总耗时计算
+        obj["completionTokensPerSecond"] = counter.seconds > 0 ? counter.completionTokens / counter.seconds : 0.0;
+        obj["totalTokensPerSecond"] = counter.seconds > 0 ? (counter.promptTokens + counter.completionTokens) / counter.seconds : 0.0;
+        endpointsJson[endpoint] = obj;
+    }
+
+    json usageJson = {
+        {"total", counterToJson(m_total)},
+        {"byApiKey", mapToJson(m_byApiKey)},
+        {"byFile", mapToJson(m_byFile)},
+        {"byRetryReason", mapToJson(m_byRetryReason)},
+        {"byEndpoint", endpointsJson},
+    };
+
+    std::ofstream ofs(filePath);
+    ofs << usageJson.dump(2);
+    ofs.close();
+
+    m_logger->info("本次共发送 {} 次请求(失败 {} 次)，输入 {} tokens(缓存命中 {})，输出 {} tokens，用量统计已保存到 {}",
+        m_total.requests, m_total.failedRequests, m_total.promptTokens, m_total.cachedTokens, m_total.completionTokens,
+        wide2Ascii(filePath.filename()));
+}
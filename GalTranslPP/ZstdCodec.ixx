@@ -0,0 +1,253 @@
+module;
+
+#include <zstd.h>
+#include <zdict.h>
+
+export module ZstdCodec;
+
+import Tool;
+
+namespace fs = std::filesystem;
+
+export {
+
+    /**
+    * @brief 判断数据是否以 zstd 帧开头，读取时据此决定是否需要解压
+    */
+    bool isZstdFrame(std::string_view data);
+
+    class ZstdCodec;
+
+    /**
+    * @brief 解压一个 zstd 帧，帧头中记录了字典 id 时必须提供对应的 codec
+    */
+    std::string decompressZstd(std::string_view data, const ZstdCodec* codec);
+
+    /**
+    * @brief 项目级的 zstd 压缩设置，可带一个用项目文本训练出来的字典
+    * 字典一旦生成就不再改变，否则之前用它压缩的文件将无法解压
+    */
+    class ZstdCodec {
+    private:
+        int m_level;
+        fs::path m_dictPath;
+        ZSTD_CDict* m_cdict = nullptr;
+        ZSTD_DDict* m_ddict = nullptr;
+
+        void loadDictionary(std::string_view dictionary);
+
+        friend class ZstdOutputStream;
+        friend std::string decompressZstd(std::string_view data, const ZstdCodec* codec);
+
+    public:
+        ZstdCodec(const fs::path& dictPath, int level);
+        ~ZstdCodec();
+
+        ZstdCodec(const ZstdCodec&) = delete;
+        ZstdCodec& operator=(const ZstdCodec&) = delete;
+
+        bool hasDictionary() const { return m_cdict != nullptr; }
+
+        /**
+        * @brief 用给定文件的内容训练字典并保存到 dictPath
+        * @return 样本不足或训练失败时返回 false，此时继续使用无字典压缩
+        */
+        bool trainDictionary(const std::vector<fs::path>& samplePaths);
+
+        std::string compress(std::string_view data) const;
+
+        /**
+        * @brief 压缩后整体写入文件
+        */
+        void writeFile(const fs::path& path, std::string_view content) const;
+    };
+
+    /**
+    * @brief 流式压缩，压缩结果直接写入给定的输出流
+    */
+    class ZstdOutputStream {
+    private:
+        ZSTD_CCtx* m_cctx;
+        std::ostream& m_os;
+        std::string m_out;
+
+    public:
+        ZstdOutputStream(const ZstdCodec& codec, std::ostream& os);
+        ~ZstdOutputStream();
+
+        ZstdOutputStream(const ZstdOutputStream&) = delete;
+        ZstdOutputStream& operator=(const ZstdOutputStream&) = delete;
+
+        /**
+        * @brief 压缩一段数据，last 为 true 时结束当前帧
+        */
+        void write(std::string_view data, bool last = false);
+    };
+}
+
+
+module :private;
+
+bool isZstdFrame(std::string_view data) {
+    return data.size() >= 4 && std::memcmp(data.data(), "\x28\xB5\x2F\xFD", 4) == 0;
+}
+
+ZstdCodec::ZstdCodec(const fs::path& dictPath, int level) : m_level(level), m_dictPath(dictPath) {
+    if (!fs::exists(m_dictPath)) {
+        return;
+    }
+    std::ifstream ifs(m_dictPath, std::ios::binary);
+    std::string dictionary((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    loadDictionary(dictionary);
+}
+
+ZstdCodec::~ZstdCodec() {
+    ZSTD_freeCDict(m_cdict);
+    ZSTD_freeDDict(m_ddict);
+}
+
+void ZstdCodec::loadDictionary(std::string_view dictionary) {
+    m_cdict = ZSTD_createCDict(dictionary.data(), dictionary.size(), m_level);
+    m_ddict = ZSTD_createDDict(dictionary.data(), dictionary.size());
+    if (!m_cdict || !m_ddict) {
+        throw std::runtime_error(std::format("无法加载 zstd 字典 {}", wide2Ascii(m_dictPath)));
+    }
+}
+
+bool ZstdCodec::trainDictionary(const std::vector<fs::path>& samplePaths) {
+    // 按 zstd 的建议，样本总量取字典大小的 100 倍左右即可
+    constexpr size_t dictCapacity = 112640;
+    constexpr size_t sampleChunkSize = 4096;
+    constexpr size_t maxSamplesSize = dictCapacity * 100;
+
+    std::string samples;
+    std::vector<size_t> sampleSizes;
+    for (const auto& path : samplePaths) {
+        if (samples.size() >= maxSamplesSize) {
+            break;
+        }
+        std::ifstream ifs(path, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        if (isZstdFrame(content)) {
+            continue;
+        }
+        for (size_t offset = 0; offset < content.size() && samples.size() < maxSamplesSize; offset += sampleChunkSize) {
+            size_t length = std::min(sampleChunkSize, content.size() - offset);
+            samples.append(content, offset, length);
+            sampleSizes.push_back(length);
+        }
+    }
+    if (sampleSizes.size() < 64) {
+        return false;
+    }
+
+    std::string dictionary(dictCapacity, '\0');
+    size_t dictSize = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), samples.data(), sampleSizes.data(), (unsigned)sampleSizes.size());
+    if (ZDICT_isError(dictSize)) {
+        return false;
+    }
+    dictionary.resize(dictSize);
+
+    createParent(m_dictPath);
+    std::ofstream ofs(m_dictPath, std::ios::binary);
+    if (!ofs.is_open()) {
+        throw std::runtime_error(std::format("无法写入文件 {}", wide2Ascii(m_dictPath)));
+    }
+    ofs.write(dictionary.data(), dictionary.size());
+    ofs.close();
+    loadDictionary(dictionary);
+    return true;
+}
+
+std::string ZstdCodec::compress(std::string_view data) const {
+    std::string result(ZSTD_compressBound(data.size()), '\0');
+    std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> cctx(ZSTD_createCCtx(), &ZSTD_freeCCtx);
+    size_t compressedSize = m_cdict
+        ? ZSTD_compress_usingCDict(cctx.get(), result.data(), result.size(), data.data(), data.size(), m_cdict)
+        : ZSTD_compressCCtx(cctx.get(), result.data(), result.size(), data.data(), data.size(), m_level);
+    if (ZSTD_isError(compressedSize)) {
+        throw std::runtime_error(std::format("zstd 压缩失败: {}", ZSTD_getErrorName(compressedSize)));
+    }
+    result.resize(compressedSize);
+    return result;
+}
+
+void ZstdCodec::writeFile(const fs::path& path, std::string_view content) const {
+    std::string compressed = compress(content);
+    std::ofstream ofs(path, std::ios::binary);
+    if (!ofs.is_open()) {
+        throw std::runtime_error(std::format("无法写入文件 {}", wide2Ascii(path)));
+    }
+    ofs.write(compressed.data(), compressed.size());
+}
+
+ZstdOutputStream::ZstdOutputStream(const ZstdCodec& codec, std::ostream& os) : m_cctx(ZSTD_createCCtx()), m_os(os) {
+    if (codec.m_cdict) {
+        ZSTD_CCtx_refCDict(m_cctx, codec.m_cdict);
+    }
+    else {
+        ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_compressionLevel, codec.m_level);
+    }
+    m_out.resize(ZSTD_CStreamOutSize());
+}
+
+ZstdOutputStream::~ZstdOutputStream() {
+    ZSTD_freeCCtx(m_cctx);
+}
+
+void ZstdOutputStream::write(std::string_view data, bool last) {
+    ZSTD_inBuffer input = { data.data(), data.size(), 0 };
+    ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+    bool finished = false;
+    while (!finished) {
+        ZSTD_outBuffer output = { m_out.data(), m_out.size(), 0 };
+        size_t remaining = ZSTD_compressStream2(m_cctx, &output, &input, mode);
+        if (ZSTD_isError(remaining)) {
+            throw std::runtime_error(std::format("zstd 压缩失败: {}", ZSTD_getErrorName(remaining)));
+        }
+        m_os.write(m_out.data(), output.pos);
+        finished = last ? remaining == 0 : input.pos == input.size;
+    }
+}
+
+std::string decompressZstd(std::string_view data, const ZstdCodec* codec) {
+    std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> dctx(ZSTD_createDCtx(), &ZSTD_freeDCtx);
+    // 没有记录字典 id 的帧是无字典压缩的，不能带着字典解压
+    unsigned dictId = ZSTD_getDictID_fromFrame(data.data(), data.size());
+    if (dictId != 0) {
+        if (!codec || !codec->m_ddict || ZSTD_getDictID_fromDDict(codec->m_ddict) != dictId) {
+            throw std::runtime_error("解压所需的 zstd 字典不存在或与项目字典不匹配");
+        }
+        ZSTD_DCtx_refDDict(dctx.get(), codec->m_ddict);
+    }
+
+    std::string result;
+    unsigned long long contentSize = ZSTD_getFrameContentSize(data.data(), data.size());
+    if (contentSize != ZSTD_CONTENTSIZE_UNKNOWN && contentSize != ZSTD_CONTENTSIZE_ERROR) {
+        result.reserve(contentSize);
+    }
+    std::string chunk(ZSTD_DStreamOutSize(), '\0');
+    ZSTD_inBuffer input = { data.data(), data.size(), 0 };
+    size_t ret = 0;
+    while (input.pos < input.size) {
+        ZSTD_outBuffer output = { chunk.data(), chunk.size(), 0 };
+        ret = ZSTD_decompressStream(dctx.get(), &output, &input);
+        if (ZSTD_isError(ret)) {
+            throw std::runtime_error(std::format("zstd 解压失败: {}", ZSTD_getErrorName(ret)));
+        }
+        result.append(chunk.data(), output.pos);
+    }
+    // 输入读完后解压器可能还有未输出的数据
+    while (ret != 0) {
+        ZSTD_outBuffer output = { chunk.data(), chunk.size(), 0 };
+        ret = ZSTD_decompressStream(dctx.get(), &output, &input);
+        if (ZSTD_isError(ret)) {
+            throw std::runtime_error(std::format("zstd 解压失败: {}", ZSTD_getErrorName(ret)));
+        }
+        if (output.pos == 0) {
+            throw std::runtime_error("zstd 数据不完整");
+        }
+        result.append(chunk.data(), output.pos);
+    }
+    return result;
+}